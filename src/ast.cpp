@@ -21,6 +21,7 @@ own<TypeWithFills> ConstInt64::dom_type_;
 own<TypeWithFills> ConstDouble::dom_type_;
 own<TypeWithFills> ConstVoid::dom_type_;
 own<TypeWithFills> ConstBool::dom_type_;
+own<TypeWithFills> ConstString::dom_type_;
 own<TypeWithFills> MkLambda::dom_type_;
 own<TypeWithFills> Call::dom_type_;
 own<TypeWithFills> GetAtIndex::dom_type_;
@@ -57,6 +58,7 @@ own<TypeWithFills> LAnd::dom_type_;
 own<TypeWithFills> Else::dom_type_;
 own<TypeWithFills> LOr::dom_type_;
 own<TypeWithFills> Loop::dom_type_;
+own<TypeWithFills> Each::dom_type_;
 own<TypeWithFills> CopyOp::dom_type_;
 own<TypeWithFills> MkWeakOp::dom_type_;
 own<TypeWithFills> DerefWeakOp::dom_type_;
@@ -109,6 +111,8 @@ void initialize() {
 	ConstVoid::dom_type_ = (new CppClassType<ConstVoid>(cpp_dom, { "m0", "VoidVal" }));
 	ConstBool::dom_type_ = (new CppClassType<ConstBool>(cpp_dom, { "m0", "BoolVal" }))
 		->field("val", pin<CppField<ConstBool, bool, &ConstBool::value>>::make(cpp_dom->mk_type(Kind::BOOL)));
+	ConstString::dom_type_ = (new CppClassType<ConstString>(cpp_dom, { "m0", "String" }))
+		->field("value", pin<CppField<ConstString, string, &ConstString::value>>::make(cpp_dom->mk_type(Kind::STRING)));
 	Get::dom_type_ = (new CppClassType<Get>(cpp_dom, { "m0", "Get" }))
 		->field("var", pin<CppField<DataRef, weak<Var>, &Get::var>>::make(weak_type));
 	Set::dom_type_ = (new CppClassType<Set>(cpp_dom, { "m0", "Set" }))
@@ -184,6 +188,7 @@ void initialize() {
 	make_bin_op<LAnd>("LAnd", op_array_2);
 	make_bin_op<Else>("Else", op_array_2);
 	make_bin_op<LOr>("LOr", op_array_2);
+	make_bin_op<Each>("Each", op_array_2);
 	TpInt64::dom_type_ = new CppClassType<TpInt64>(cpp_dom, {"m0", "Type", "Int64"});
 	TpDouble::dom_type_ = new CppClassType<TpDouble>(cpp_dom, { "m0", "Type", "Double" });
 	TpFunction::dom_type_ = (new CppClassType<TpFunction>(cpp_dom, { "m0", "Type", "Function" }))
@@ -228,6 +233,7 @@ void ConstInt64::match(ActionMatcher& matcher) { matcher.on_const_i64(*this); }
 void ConstDouble::match(ActionMatcher& matcher) { matcher.on_const_double(*this); }
 void ConstVoid::match(ActionMatcher& matcher) { matcher.on_const_void(*this); }
 void ConstBool::match(ActionMatcher& matcher) { matcher.on_const_bool(*this); }
+void ConstString::match(ActionMatcher& matcher) { matcher.on_const_string(*this); }
 void Get::match(ActionMatcher& matcher) { matcher.on_get(*this); }
 void Set::match(ActionMatcher& matcher) { matcher.on_set(*this); }
 void GetField::match(ActionMatcher& matcher) { matcher.on_get_field(*this); }
@@ -245,6 +251,7 @@ void NotOp::match(ActionMatcher& matcher) { matcher.on_not(*this); }
 void NegOp::match(ActionMatcher& matcher) { matcher.on_neg(*this); }
 void RefOp::match(ActionMatcher& matcher) { matcher.on_ref(*this); }
 void Loop::match(ActionMatcher& matcher) { matcher.on_loop(*this); }
+void Each::match(ActionMatcher& matcher) { matcher.on_each(*this); }
 void CopyOp::match(ActionMatcher& matcher) { matcher.on_copy(*this); }
 void MkWeakOp::match(ActionMatcher& matcher) { matcher.on_mk_weak(*this); }
 void DerefWeakOp::match(ActionMatcher& matcher) { matcher.on_deref_weak(*this); }
@@ -274,6 +281,7 @@ void ActionMatcher::on_const_i64(ConstInt64& node) { on_unmatched(node); }
 void ActionMatcher::on_const_double(ConstDouble& node) { on_unmatched(node); }
 void ActionMatcher::on_const_void(ConstVoid& node) { on_unmatched(node); }
 void ActionMatcher::on_const_bool(ConstBool& node) { on_unmatched(node); }
+void ActionMatcher::on_const_string(ConstString& node) { on_unmatched(node); }
 void ActionMatcher::on_get(Get& node) { on_unmatched(node); }
 void ActionMatcher::on_set(Set& node) { on_unmatched(node); }
 void ActionMatcher::on_get_field(GetField& node) { on_unmatched(node); }
@@ -312,6 +320,7 @@ void ActionMatcher::on_if(If& node) { on_bin_op(node); }
 void ActionMatcher::on_land(LAnd& node) { on_bin_op(node); }
 void ActionMatcher::on_else(Else& node) { on_bin_op(node); }
 void ActionMatcher::on_lor(LOr& node) { on_bin_op(node); }
+void ActionMatcher::on_each(Each& node) { on_bin_op(node); }
 
 void ActionMatcher::fix(own<Action>& ptr) {
 	auto saved = fix_result;
@@ -409,18 +418,56 @@ Ast::Ast()
 	object = mk_class("Object");
 	auto container = mk_class("Container", {
 		mk_field("_size", new ConstInt64),
-		mk_field("_data", new ConstInt64) });
+		mk_field("_data", new ConstInt64),
+		mk_field("_capacity", new ConstInt64) });
+	for (int i = 0; i < 8; i++)  // inline items, see Blob::inline_items
+		container->fields.push_back(mk_field(("_inline" + std::to_string(i)).c_str(), new ConstInt64));
 	mk_fn(sys->get("Container")->get("size"), new ConstInt64, { get_ref(container) });
 	mk_fn(sys->get("Container")->get("insert"), new ConstVoid, { get_ref(container), tp_int64(), tp_int64()});
 	mk_fn(sys->get("Container")->get("move"), new ConstBool, { get_ref(container), tp_int64(), tp_int64(), tp_int64() });
+	mk_fn(sys->get("Container")->get("reserve"), new ConstVoid, { get_ref(container), tp_int64() });
+	mk_fn(sys->get("Container")->get("shrink"), new ConstVoid, { get_ref(container) });
 	blob = mk_class("Blob");
 	blob->overloads[container];
+	mk_fn(sys->get("Container")->get("moveRanges"), new ConstBool, { get_ref(container), get_ref(blob), tp_int64() });
 	mk_fn(sys->get("Blob")->get("getAt"), new ConstInt64, { get_ref(blob), tp_int64() });
 	mk_fn(sys->get("Blob")->get("setAt"), new ConstVoid, { get_ref(blob), tp_int64(), tp_int64() });
 	mk_fn(sys->get("Blob")->get("getByteAt"), new ConstInt64, { get_ref(blob), tp_int64() });
 	mk_fn(sys->get("Blob")->get("setByteAt"), new ConstVoid, { get_ref(blob), tp_int64(), tp_int64() });
 	mk_fn(sys->get("Blob")->get("delete"), new ConstVoid, { get_ref(blob), tp_int64(), tp_int64() });
 	mk_fn(sys->get("Blob")->get("copy"), new ConstBool, { get_ref(blob), tp_int64(), get_ref(container), tp_int64(), tp_int64() });
+	mk_fn(sys->get("Blob")->get("fill"), new ConstVoid, { get_ref(blob), tp_int64(), tp_int64(), tp_int64() });
+	mk_fn(sys->get("Blob")->get("sum"), new ConstInt64, { get_ref(blob) });
+	mk_fn(sys->get("Blob")->get("min"), new ConstInt64, { get_ref(blob) });
+	mk_fn(sys->get("Blob")->get("max"), new ConstInt64, { get_ref(blob) });
+	mk_fn(sys->get("Blob")->get("compare"), new ConstInt64, { get_ref(blob), get_ref(blob) });
+	mk_fn(sys->get("Blob")->get("findByte"), new ConstInt64, { get_ref(blob), tp_int64(), tp_int64() });
+	mk_fn(sys->get("Blob")->get("findInt"), new ConstInt64, { get_ref(blob), tp_int64(), tp_int64() });
+	mk_fn(sys->get("Blob")->get("count"), new ConstInt64, { get_ref(blob), tp_int64() });
+	mk_fn(sys->get("Blob")->get("add"), new ConstVoid, { get_ref(blob), get_ref(blob) });
+	mk_fn(sys->get("Blob")->get("mul"), new ConstVoid, { get_ref(blob), get_ref(blob) });
+	mk_fn(sys->get("Blob")->get("sort"), new ConstVoid, { get_ref(blob) });
+	mk_fn(sys->get("Blob")->get("sortIndices"), new ConstBool, { get_ref(blob), get_ref(blob) });
+	mk_fn(sys->get("Blob")->get("lowerBound"), new ConstInt64, { get_ref(blob), tp_int64() });
+	mk_fn(sys->get("Blob")->get("upperBound"), new ConstInt64, { get_ref(blob), tp_int64() });
+	mk_fn(sys->get("Blob")->get("hash"), new ConstInt64, { get_ref(blob), tp_int64(), tp_int64(), tp_int64() });  // blob, from byte, bytes, seed
+	mk_fn(sys->get("Blob")->get("hashInt"), new ConstInt64, { tp_int64(), tp_int64() });
+	mk_fn(sys->get("Blob")->get("putInt"), new ConstInt64, { get_ref(blob), tp_int64(), tp_int64() });  // blob, at byte, value
+	mk_fn(sys->get("Blob")->get("putDouble"), new ConstInt64, { get_ref(blob), tp_int64(), tp_double() });
+	mk_fn(sys->get("Blob")->get("parseInt"), new ConstInt64, { get_ref(blob), tp_int64() });
+	mk_fn(sys->get("Blob")->get("parseDouble"), new ConstDouble, { get_ref(blob), tp_int64() });
+	mk_fn(sys->get("Blob")->get("numberEnd"), new ConstInt64, { get_ref(blob), tp_int64() });
+	bitset = mk_class("Bitset");  // bits in Blob items, see Blob::set_bit
+	bitset->overloads[blob];
+	mk_fn(sys->get("Bitset")->get("set"), new ConstVoid, { get_ref(bitset), tp_int64() });
+	mk_fn(sys->get("Bitset")->get("clear"), new ConstVoid, { get_ref(bitset), tp_int64() });
+	mk_fn(sys->get("Bitset")->get("test"), new ConstBool, { get_ref(bitset), tp_int64() });
+	mk_fn(sys->get("Bitset")->get("and"), new ConstVoid, { get_ref(bitset), get_ref(bitset) });
+	mk_fn(sys->get("Bitset")->get("or"), new ConstVoid, { get_ref(bitset), get_ref(bitset) });
+	mk_fn(sys->get("Bitset")->get("xor"), new ConstVoid, { get_ref(bitset), get_ref(bitset) });
+	mk_fn(sys->get("Bitset")->get("andNot"), new ConstVoid, { get_ref(bitset), get_ref(bitset) });
+	mk_fn(sys->get("Bitset")->get("popcount"), new ConstInt64, { get_ref(bitset) });
+	mk_fn(sys->get("Bitset")->get("findNext"), new ConstInt64, { get_ref(bitset), tp_int64() });
 	auto inst = new ast::MkInstance;
 	inst->cls = object.pinned();
 	auto ref_to_object = new ast::RefOp;
@@ -430,9 +477,16 @@ Ast::Ast()
 	opt_ref_to_object->p[1] = ref_to_object;
 	own_array = mk_class("Array");
 	own_array->overloads[container];
+	own_arrays.push_back(own_array);
+	array_items_[own_array] = object;
 	mk_fn(sys->get("Array")->get("getAt"), opt_ref_to_object, { get_ref(own_array), tp_int64() });
 	mk_fn(sys->get("Array")->get("setAt"), new ConstVoid, { get_ref(own_array), tp_int64(), object });
 	mk_fn(sys->get("Array")->get("delete"), new ConstVoid, { get_ref(own_array), tp_int64(), tp_int64() });
+	mk_fn(sys->get("Array")->get("sort"), new ConstVoid, {  // see Generator::build_sort
+		get_ref(own_array),
+		tp_lambda({ tp_optional(get_ref(object)), tp_optional(get_ref(object)), tp_optional(tp_void()) }) });
+	for (auto name : { "getAt", "setAt", "delete", "sort" })  // `each` over sys_Array(T) types items by itself
+		typed_array_fns.push_back(functions_by_names[sys->get("Array")->get(name)]);
 	weak_array = mk_class("WeakArray");
 	weak_array->overloads[container];
 	auto weak_to_object = new ast::MkWeakOp;
@@ -440,6 +494,143 @@ Ast::Ast()
 	mk_fn(sys->get("WeakArray")->get("getAt"), weak_to_object, { get_ref(weak_array), tp_int64() });
 	mk_fn(sys->get("WeakArray")->get("setAt"), new ConstVoid, { get_ref(weak_array), tp_int64(), get_weak(object) });
 	mk_fn(sys->get("WeakArray")->get("delete"), new ConstVoid, { get_ref(weak_array), tp_int64(), tp_int64() });
+	auto map = mk_class("Map", {  // see hash_map::Table
+		mk_field("_size", new ConstInt64),
+		mk_field("_capacity", new ConstInt64),
+		mk_field("_growthLeft", new ConstInt64),
+		mk_field("_data", new ConstInt64) });
+	maps.push_back(map);
+	mk_fn(sys->get("Map")->get("size"), new ConstInt64, { get_ref(map) });
+	auto mk_map = [&](const char* name, pin<Type> key, pin<Action> value_type, pin<Type> value) {
+		auto r = mk_class(name);
+		r->overloads[map];
+		maps.push_back(r);
+		auto& cls = r->name;
+		mk_fn(cls->get("getAt"), value_type, { get_ref(r), key });
+		mk_fn(cls->get("setAt"), new ConstVoid, { get_ref(r), key, value });
+		mk_fn(cls->get("has"), new ConstBool, { get_ref(r), key });
+		mk_fn(cls->get("delete"), new ConstBool, { get_ref(r), key });
+		mk_fn(cls->get("clear"), new ConstVoid, { get_ref(r) });
+	};
+	mk_map("IntMap", tp_int64(), new ConstInt64, tp_int64());
+	mk_map("IntOwnMap", tp_int64(), opt_ref_to_object, object);
+	mk_map("IntWeakMap", tp_int64(), weak_to_object, get_weak(object));
+	mk_map("ObjIntMap", get_ref(object), new ConstInt64, tp_int64());
+	mk_map("ObjOwnMap", get_ref(object), opt_ref_to_object, object);
+	mk_map("ObjWeakMap", get_ref(object), weak_to_object, get_weak(object));
+	auto deque = mk_class("Deque", {  // see Deque in generator.cpp
+		mk_field("_size", new ConstInt64),
+		mk_field("_data", new ConstInt64),
+		mk_field("_capacity", new ConstInt64),
+		mk_field("_head", new ConstInt64) });
+	deques.push_back(deque);
+	mk_fn(sys->get("Deque")->get("size"), new ConstInt64, { get_ref(deque) });
+	auto mk_deque = [&](const char* name, pin<Action> item_type, pin<Type> item) {
+		auto r = mk_class(name);
+		r->overloads[deque];
+		deques.push_back(r);
+		auto& cls = r->name;
+		mk_fn(cls->get("pushBack"), new ConstVoid, { get_ref(r), item });
+		mk_fn(cls->get("pushFront"), new ConstVoid, { get_ref(r), item });
+		mk_fn(cls->get("popBack"), item_type, { get_ref(r) });
+		mk_fn(cls->get("popFront"), item_type, { get_ref(r) });
+		mk_fn(cls->get("getAt"), item_type, { get_ref(r), tp_int64() });
+		mk_fn(cls->get("clear"), new ConstVoid, { get_ref(r) });
+	};
+	mk_deque("IntDeque", new ConstInt64, tp_int64());
+	mk_deque("OwnDeque", opt_ref_to_object, object);
+	string_cls = mk_class("String", {  // see String in generator.cpp, `_size` and `_data` are placed as in Container
+		mk_field("_size", new ConstInt64),
+		mk_field("_data", new ConstInt64) });
+	for (int i = 0; i < 3; i++)  // inline bytes, see String::inline_bytes
+		string_cls->fields.push_back(mk_field(("_inline" + std::to_string(i)).c_str(), new ConstInt64));
+	auto new_string = new ast::MkInstance;
+	new_string->cls = string_cls.pinned();
+	auto string_ref = get_ref(string_cls);
+	mk_fn(sys->get("String")->get("size"), new ConstInt64, { string_ref });
+	mk_fn(sys->get("String")->get("getAt"), new ConstInt64, { string_ref, tp_int64() });
+	mk_fn(sys->get("String")->get("concat"), new_string, { string_ref, string_ref });
+	mk_fn(sys->get("String")->get("slice"), new_string, { string_ref, tp_int64(), tp_int64() });
+	mk_fn(sys->get("String")->get("compare"), new ConstInt64, { string_ref, string_ref });
+	mk_fn(sys->get("String")->get("hash"), new ConstInt64, { string_ref });
+	auto new_blob = new ast::MkInstance;
+	new_blob->cls = blob.pinned();
+	auto opt_new_blob = new ast::If;
+	opt_new_blob->p[0] = new ast::ConstBool;
+	opt_new_blob->p[1] = new_blob;
+	mk_fn(sys->get("Blob")->get("mapFile"), opt_new_blob, { string_ref });
+	mk_fn(sys->get("Blob")->get("view"), new_blob, { get_ref(blob), tp_int64(), tp_int64() });
+	byte_buffer = mk_class("ByteBuffer", {  // see ByteBuffer in generator.cpp, laid out as Container with `_size` in bytes
+		mk_field("_size", new ConstInt64),
+		mk_field("_data", new ConstInt64),
+		mk_field("_capacity", new ConstInt64) });
+	for (int i = 0; i < 8; i++)  // inline words, see ByteBuffer::inline_words
+		byte_buffer->fields.push_back(mk_field(("_inline" + std::to_string(i)).c_str(), new ConstInt64));
+	auto byte_buffer_ref = get_ref(byte_buffer);
+	mk_fn(sys->get("ByteBuffer")->get("size"), new ConstInt64, { byte_buffer_ref });
+	mk_fn(sys->get("ByteBuffer")->get("resize"), new ConstVoid, { byte_buffer_ref, tp_int64() });
+	mk_fn(sys->get("ByteBuffer")->get("copy"), new ConstBool, { byte_buffer_ref, tp_int64(), byte_buffer_ref, tp_int64(), tp_int64() });
+	mk_fn(sys->get("ByteBuffer")->get("getAt"), new ConstInt64, { byte_buffer_ref, tp_int64() });
+	mk_fn(sys->get("ByteBuffer")->get("setAt"), new ConstVoid, { byte_buffer_ref, tp_int64(), tp_int64() });
+	for (auto suffix : { "", "Be" }) {
+		auto name = [&](const char* prefix, const char* type) {
+			return sys->get("ByteBuffer")->get((std::string(prefix) + type + suffix).c_str());
+		};
+		for (auto type : { "I16", "I32", "I64" }) {
+			mk_fn(name("get", type), new ConstInt64, { byte_buffer_ref, tp_int64() });
+			mk_fn(name("set", type), new ConstVoid, { byte_buffer_ref, tp_int64(), tp_int64() });
+		}
+		mk_fn(name("get", "F64"), new ConstDouble, { byte_buffer_ref, tp_int64() });
+		mk_fn(name("set", "F64"), new ConstVoid, { byte_buffer_ref, tp_int64(), tp_double() });
+	}
+	mk_fn(sys->get("ByteBuffer")->get("appendByte"), new ConstVoid, { byte_buffer_ref, tp_int64() });
+	mk_fn(sys->get("ByteBuffer")->get("appendBlob"), new ConstBool, { byte_buffer_ref, get_ref(blob), tp_int64(), tp_int64() });
+	mk_fn(sys->get("ByteBuffer")->get("appendBuffer"), new ConstVoid, { byte_buffer_ref, byte_buffer_ref });
+	mk_fn(sys->get("ByteBuffer")->get("appendInt"), new ConstVoid, { byte_buffer_ref, tp_int64() });
+	mk_fn(sys->get("ByteBuffer")->get("appendDouble"), new ConstVoid, { byte_buffer_ref, tp_double() });
+	mk_fn(sys->get("ByteBuffer")->get("finish"), new_blob, { byte_buffer_ref });
+	mk_fn(sys->get("ByteBuffer")->get("putInt"), new ConstInt64, { byte_buffer_ref, tp_int64(), tp_int64() });
+	mk_fn(sys->get("ByteBuffer")->get("putDouble"), new ConstInt64, { byte_buffer_ref, tp_int64(), tp_double() });
+	mk_fn(sys->get("ByteBuffer")->get("parseInt"), new ConstInt64, { byte_buffer_ref, tp_int64() });
+	mk_fn(sys->get("ByteBuffer")->get("parseDouble"), new ConstDouble, { byte_buffer_ref, tp_int64() });
+	mk_fn(sys->get("ByteBuffer")->get("numberEnd"), new ConstInt64, { byte_buffer_ref, tp_int64() });
+	rope_cls = mk_class("Rope", {  // see Rope in generator.cpp
+		mk_field("_root", new ConstInt64) });
+	auto new_rope = new ast::MkInstance;
+	new_rope->cls = rope_cls.pinned();
+	auto rope_ref = get_ref(rope_cls);
+	mk_fn(sys->get("Rope")->get("size"), new ConstInt64, { rope_ref });
+	mk_fn(sys->get("Rope")->get("getAt"), new ConstInt64, { rope_ref, tp_int64() });
+	mk_fn(sys->get("Rope")->get("appendBlob"), new ConstBool, { rope_ref, get_ref(blob), tp_int64(), tp_int64() });
+	mk_fn(sys->get("Rope")->get("append"), new ConstVoid, { rope_ref, rope_ref });
+	mk_fn(sys->get("Rope")->get("slice"), new_rope, { rope_ref, tp_int64(), tp_int64() });
+	mk_fn(sys->get("Rope")->get("finish"), new_blob, { rope_ref });
+	channel_cls = mk_class("Channel", {  // see Channel in generator.cpp
+		mk_field("_queue", new ConstInt64) });
+	auto channel_ref = get_ref(channel_cls);
+	mk_fn(sys->get("Channel")->get("send"), new ConstBool, { channel_ref, object });  // see Generator::channel_send
+	mk_fn(sys->get("Channel")->get("receive"), opt_ref_to_object, { channel_ref });  // waits, null once closed and drained
+	mk_fn(sys->get("Channel")->get("tryReceive"), opt_ref_to_object, { channel_ref });
+	mk_fn(sys->get("Channel")->get("close"), new ConstVoid, { channel_ref });
+	file_cls = mk_class("File", {  // see File in generator.cpp
+		mk_field("_handle", new ConstInt64),
+		mk_field("_buffer", new ConstInt64),
+		mk_field("_pos", new ConstInt64),
+		mk_field("_end", new ConstInt64),
+		mk_field("_flags", new ConstInt64) });
+	auto new_file = new ast::MkInstance;
+	new_file->cls = file_cls.pinned();
+	auto opt_new_file = new ast::If;
+	opt_new_file->p[0] = new ast::ConstBool;
+	opt_new_file->p[1] = new_file;
+	auto file_ref = get_ref(file_cls);
+	mk_fn(sys->get("File")->get("open"), opt_new_file, { string_ref, tp_int64() });  // flags: 1 - write, 2 - direct
+	mk_fn(sys->get("File")->get("read"), new ConstInt64, { file_ref, get_ref(blob), tp_int64(), tp_int64() });
+	mk_fn(sys->get("File")->get("write"), new ConstInt64, { file_ref, get_ref(blob), tp_int64(), tp_int64() });
+	mk_fn(sys->get("File")->get("seek"), new ConstInt64, { file_ref, tp_int64() });
+	mk_fn(sys->get("File")->get("flush"), new ConstBool, { file_ref });
+	mk_fn(sys->get("HeapImage")->get("save"), new ConstBool, { get_ref(object) });
+	mk_fn(sys->get("HeapImage")->get("load"), opt_ref_to_object, {});
 }
 
 pin<TpInt64> Ast::tp_int64() {
@@ -537,6 +728,29 @@ pin<TpClass> Ast::extract_class(pin<Type> pointer) {
 	return nullptr;
 }
 
+// Typed arrays are sys_Array at run time, only the type checker tells them apart.
+// They don't extend sys_Array, otherwise any object could be stored in them through a sys_Array reference.
+pin<TpClass> Ast::get_typed_array(pin<TpClass> item) {
+	auto& r = typed_arrays_[item];
+	if (!r) {
+		r = new TpClass;
+		// Parens can't appear in identifiers, so the name doesn't clash with classes and functions of programs.
+		r->name = own_array->name->domain->get("Array(" + std::to_string(item->name.pinned()) + ")");
+		r->base_class = own_array->base_class;
+		for (auto& base : own_array->overloads)
+			r->overloads[base.first];
+		r->this_names = own_array->this_names;
+		own_arrays.push_back(r);
+		array_items_[r] = item;
+	}
+	return r;
+}
+
+pin<TpClass> Ast::array_item(pin<TpClass> cls) {
+	auto it = array_items_.find(cls);
+	return it == array_items_.end() ? nullptr : it->second.pinned();
+}
+
 void Node::err_out(const std::string& message) {
 	std::cerr << message;
 	throw 1;
@@ -179,8 +179,20 @@ struct Ast: dom::DomItem {
 	own<Function> entry_point;
 	weak<TpClass> object;
 	weak<TpClass> blob;
+	weak<TpClass> bitset;
 	weak<TpClass> own_array;
 	weak<TpClass> weak_array;
+	vector<weak<TpClass>> own_arrays;  // sys_Array and its typed instantiations sys_Array(T), see get_typed_array
+	unordered_map<own<TpClass>, own<TpClass>> typed_arrays_;  // item class -> sys_Array(item)
+	unordered_map<weak<TpClass>, weak<TpClass>> array_items_;  // own array -> its item class
+	vector<weak<struct Function>> typed_array_fns;  // sys_Array functions that take or return items as T for sys_Array(T)
+	vector<weak<TpClass>> maps;  // sys_Map and its specializations
+	vector<weak<TpClass>> deques;  // sys_Deque and its specializations
+	weak<TpClass> string_cls;
+	weak<TpClass> file_cls;
+	weak<TpClass> byte_buffer;
+	weak<TpClass> rope_cls;
+	weak<TpClass> channel_cls;
 	vector<own<TpClass>> classes;
 	vector<own<struct Function>> functions;
 
@@ -196,6 +208,8 @@ struct Ast: dom::DomItem {
 	pin<TpClass> get_class(pin<dom::Name> name); // gets or creates class
 	pin<TpClass> peek_class(pin<dom::Name> name); // gets class or null
 	pin<TpClass> extract_class(pin<Type> pointer); // extracts class from own, weak or pin pointer
+	pin<TpClass> get_typed_array(pin<TpClass> item); // gets or creates sys_Array(item), it is added to `classes` after type check
+	pin<TpClass> array_item(pin<TpClass> cls); // item class of an own array - Object for sys_Array, null for non-arrays
 	DECLARE_DOM_CLASS(Ast);
 };
 
@@ -222,6 +236,12 @@ struct ConstBool : Action {  // it produces optional<void>
 	DECLARE_DOM_CLASS(ConstBool);
 };
 
+struct ConstString : Action {  // UTF-8 bytes, produces ref to immortal sys_String
+	string value;
+	void match(ActionMatcher& matcher) override;
+	DECLARE_DOM_CLASS(ConstString);
+};
+
 struct Block : Action {
 	vector<own<Var>> names; // locals or params
 	vector<own<Action>> body;
@@ -416,6 +436,10 @@ struct Loop : UnaryOp {
 	void match(ActionMatcher& matcher) override;
 	DECLARE_DOM_CLASS(Loop);
 };
+struct Each : BinaryOp {  // p[0] - container, p[1] - Block with the item as its first local
+	void match(ActionMatcher& matcher) override;
+	DECLARE_DOM_CLASS(Each);
+};
 
 struct ToIntOp : UnaryOp {
 	void match(ActionMatcher& matcher) override;
@@ -448,6 +472,7 @@ struct ActionMatcher {
 	virtual void on_const_double(ConstDouble& node);
 	virtual void on_const_void(ConstVoid& node);
 	virtual void on_const_bool(ConstBool& node);
+	virtual void on_const_string(ConstString& node);
 	virtual void on_get(Get& node);
 	virtual void on_set(Set& node);
 	virtual void on_get_field(GetField& node);
@@ -478,6 +503,7 @@ struct ActionMatcher {
 	virtual void on_else(Else& node);
 	virtual void on_lor(LOr& node);
 	virtual void on_loop(Loop& node);
+	virtual void on_each(Each& node);
 	virtual void on_copy(CopyOp& node);
 	virtual void on_mk_weak(MkWeakOp& node);
 	virtual void on_deref_weak(DerefWeakOp& node);
@@ -0,0 +1,115 @@
+// Benchmarks for container item moves, sorting and searching.
+// Compares in-place rotation with the former temp-buffer move and single-pass range moves with per-range moves,
+// radix sorts with std::sort and std::stable_sort, branchless bounds with std::lower_bound,
+// and byte hashing with std::hash.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include "blob_util.h"
+
+using std::vector;
+
+namespace {
+
+// The move as it was implemented before in-place rotation.
+void move_with_temp(int64_t* data, size_t a, size_t b, size_t c) {
+	auto temp = new int64_t[b - a];
+	memmove(temp, data + a, sizeof(int64_t) * (b - a));
+	memmove(data + a, data + b, sizeof(int64_t) * (c - b));
+	memmove(data + a + (c - b), temp, sizeof(int64_t) * (b - a));
+	delete[] temp;
+}
+
+template<typename FN>
+void measure(const char* name, int iterations, FN fn) {
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++)
+		fn();
+	std::chrono::duration<double, std::micro> time = std::chrono::steady_clock::now() - start;
+	printf("%-40s %12.1f us/op\n", name, time.count() / iterations);
+}
+
+}  // namespace
+
+int main() {
+	const size_t size = 8 << 20;  // 64MB of items
+	vector<int64_t> items(size);
+	for (size_t i = 0; i < size; i++)
+		items[i] = i;
+	for (size_t shift : { size_t(1), size_t(1000), size / 8, size / 2 }) {
+		char name[64];
+		snprintf(name, sizeof(name), "move %zu of %zu, temp buffer", shift, size);
+		measure(name, 10, [&] { move_with_temp(items.data(), 0, shift, size); });
+		snprintf(name, sizeof(name), "move %zu of %zu, std::rotate", shift, size);
+		measure(name, 10, [&] { std::rotate(items.data(), items.data() + shift, items.data() + size); });
+		snprintf(name, sizeof(name), "move %zu of %zu, blob_util::rotate", shift, size);
+		measure(name, 10, [&] { blob_util::rotate(items.data(), items.data() + shift, items.data() + size); });
+	}
+	vector<int64_t> ranges;
+	for (size_t i = 0; i < size; i += size / 64)
+		ranges.insert(ranges.end(), { int64_t(i), int64_t(i + size / 256) });
+	measure("move 64 ranges to end, one at a time", 4, [&] {
+		for (size_t i = ranges.size(); i > 0; i -= 2)  // right to left, so remaining ranges stay in place
+			blob_util::rotate(items.data() + ranges[i - 2], items.data() + ranges[i - 1], items.data() + size);
+	});
+	measure("move 64 ranges to end, move_ranges", 4, [&] {
+		blob_util::move_ranges(items.data(), size, ranges.data(), ranges.size() / 2, size);
+	});
+
+	const size_t sort_size = 10000000;
+	vector<int64_t> keys(sort_size), sorted(sort_size), indices(sort_size);
+	uint64_t seed = 1;
+	for (auto& k : keys) {
+		seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+		k = int64_t(seed);
+	}
+	measure("sort 10M items, std::sort", 3, [&] {
+		sorted = keys;
+		std::sort(sorted.begin(), sorted.end());
+	});
+	measure("sort 10M items, blob_util::radix_sort", 3, [&] {
+		sorted = keys;
+		blob_util::radix_sort(sorted.data(), sort_size);
+	});
+	measure("sort 10M indices, std::stable_sort", 3, [&] {
+		for (size_t i = 0; i < sort_size; i++)
+			indices[i] = i;
+		std::stable_sort(indices.begin(), indices.end(), [&](int64_t a, int64_t b) { return keys[a] < keys[b]; });
+	});
+	measure("sort 10M indices, blob_util::sort_indices", 3, [&] {
+		blob_util::sort_indices(keys.data(), sort_size, indices.data());
+	});
+	int64_t found = 0;
+	measure("1M lookups in 10M, std::lower_bound", 3, [&] {
+		for (size_t i = 0; i < 1000000; i++)
+			found += std::lower_bound(sorted.begin(), sorted.end(), keys[i]) - sorted.begin();
+	});
+	measure("1M lookups in 10M, blob_util::lower_bound", 3, [&] {
+		for (size_t i = 0; i < 1000000; i++)
+			found += blob_util::lower_bound(sorted.data(), sort_size, keys[i]);
+	});
+
+	vector<char> bytes(64 << 20);
+	for (size_t i = 0; i < bytes.size(); i++)
+		bytes[i] = char(keys[i % sort_size]);
+	uint64_t hashes = 0;
+	measure("hash 64MB, std::hash<string_view>", 5, [&] {
+		hashes += std::hash<std::string_view>()(std::string_view(bytes.data(), bytes.size()));
+	});
+	measure("hash 64MB, blob_util::hash", 5, [&] {
+		hashes += blob_util::hash(bytes.data(), bytes.size(), 0);
+	});
+	measure("hash 1M cached 24-byte keys, std::hash<string_view>", 5, [&] {
+		for (size_t i = 0; i < 1000000; i++)
+			hashes += std::hash<std::string_view>()(std::string_view(bytes.data() + i % 4096 * 24, 24));
+	});
+	measure("hash 1M cached 24-byte keys, blob_util::hash", 5, [&] {
+		for (size_t i = 0; i < 1000000; i++)
+			hashes += blob_util::hash(bytes.data() + i % 4096 * 24, 24, 0);
+	});
+	return found == 0 && hashes == 0;  // keeps the lookups and hashes alive
+}
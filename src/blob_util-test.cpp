@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <vector>
+#include "fake-gunit.h"
+#include "blob_util.h"
+
+namespace {
+
+using std::vector;
+
+// Sizes around every vector width, so both the vector loops and their tails are covered.
+const size_t max_size = 41;
+
+vector<int64_t> make_items(size_t size, int64_t seed) {
+	vector<int64_t> r(size);
+	for (size_t i = 0; i < size; i++)
+		r[i] = int64_t((i + 1) * 0x9E3779B97F4A7C15ull * uint64_t(seed)) >> 8;
+	return r;
+}
+
+TEST(BlobUtil, Fill) {
+	for (size_t size = 0; size < max_size; size++) {
+		vector<int64_t> items(size + 1, 7);
+		blob_util::fill(items.data(), size, -3);
+		for (size_t i = 0; i < size; i++)
+			ASSERT_EQ(items[i], -3);
+		ASSERT_EQ(items[size], 7);
+	}
+}
+
+TEST(BlobUtil, SumMinMax) {
+	for (size_t size = 1; size < max_size; size++) {
+		auto items = make_items(size, 3);
+		int64_t sum = 0, min = items[0], max = items[0];
+		for (auto i : items) {
+			sum += i;
+			min = i < min ? i : min;
+			max = i > max ? i : max;
+		}
+		ASSERT_EQ(blob_util::sum(items.data(), size), sum);
+		ASSERT_EQ(blob_util::min(items.data(), size), min);
+		ASSERT_EQ(blob_util::max(items.data(), size), max);
+	}
+	ASSERT_EQ(blob_util::sum(nullptr, 0), 0);
+}
+
+TEST(BlobUtil, AddMul) {
+	for (size_t size = 0; size < max_size; size++) {
+		auto a = make_items(size, 5);
+		auto b = make_items(size, -7);
+		auto sum = a, product = a;
+		blob_util::add(sum.data(), b.data(), size);
+		blob_util::mul(product.data(), b.data(), size);
+		for (size_t i = 0; i < size; i++) {
+			ASSERT_EQ(sum[i], int64_t(uint64_t(a[i]) + uint64_t(b[i])));
+			ASSERT_EQ(product[i], int64_t(uint64_t(a[i]) * uint64_t(b[i])));
+		}
+	}
+}
+
+TEST(BlobUtil, FindCountMismatch) {
+	for (size_t size = 0; size < max_size; size++) {
+		auto items = make_items(size, 11);
+		ASSERT_EQ(blob_util::find(items.data(), size, 42), size);
+		ASSERT_EQ(blob_util::count(items.data(), size, 42), 0);
+		ASSERT_EQ(blob_util::mismatch(items.data(), items.data(), size), size);
+		for (size_t at = 0; at < size; at++) {
+			auto other = items;
+			other[at] ^= 1ll << 40;  // differs in the high half only
+			ASSERT_EQ(blob_util::mismatch(items.data(), other.data(), size), at);
+			other[at] = 42;
+			if (at + 2 < size)
+				other[at + 2] = 42;
+			ASSERT_EQ(blob_util::find(other.data(), size, 42), at);
+			ASSERT_EQ(blob_util::count(other.data(), size, 42), at + 2 < size ? 2 : 1);
+		}
+	}
+}
+
+TEST(BlobUtil, FindByte) {
+	for (size_t size = 0; size < max_size * 2; size++) {
+		vector<uint8_t> bytes(size, 1);
+		ASSERT_EQ(blob_util::find_byte(bytes.data(), size, 0), size);
+		for (size_t at = 0; at < size; at++) {
+			bytes[at] = 0;
+			ASSERT_EQ(blob_util::find_byte(bytes.data(), size, 0), at);
+			bytes[at] = 1;
+		}
+	}
+}
+
+TEST(BlobUtil, BitOps) {
+	for (size_t size = 0; size < max_size; size++) {
+		auto a = make_items(size, 17);
+		auto b = make_items(size, -5);
+		auto r_and = a, r_or = a, r_xor = a, r_andnot = a;
+		blob_util::bit_and(r_and.data(), b.data(), size);
+		blob_util::bit_or(r_or.data(), b.data(), size);
+		blob_util::bit_xor(r_xor.data(), b.data(), size);
+		blob_util::bit_andnot(r_andnot.data(), b.data(), size);
+		uint64_t bits = 0;
+		for (size_t i = 0; i < size; i++) {
+			ASSERT_EQ(r_and[i], a[i] & b[i]);
+			ASSERT_EQ(r_or[i], a[i] | b[i]);
+			ASSERT_EQ(r_xor[i], a[i] ^ b[i]);
+			ASSERT_EQ(r_andnot[i], a[i] & ~b[i]);
+			for (auto v = uint64_t(a[i]); v; v &= v - 1)
+				bits++;
+		}
+		ASSERT_EQ(blob_util::popcount(a.data(), size), bits);
+	}
+	vector<int64_t> ones(max_size, -1);
+	ASSERT_EQ(blob_util::popcount(ones.data(), max_size), max_size * 64);
+}
+
+TEST(BlobUtil, FindSetBit) {
+	for (size_t size = 0; size < max_size; size++) {
+		vector<int64_t> bits(size);
+		ASSERT_EQ(blob_util::find_set_bit(bits.data(), size, 0), size * 64);
+		for (size_t at : { size_t(0), size_t(1), size * 64 / 3, size * 64 - 1 }) {
+			if (at >= size * 64)
+				continue;
+			bits[at / 64] |= int64_t(1) << (at % 64);
+			ASSERT_EQ(blob_util::find_set_bit(bits.data(), size, 0), at);
+			ASSERT_EQ(blob_util::find_set_bit(bits.data(), size, at), at);
+			ASSERT_EQ(blob_util::find_set_bit(bits.data(), size, at + 1), size * 64);
+			ASSERT_EQ(blob_util::find_set_bit(bits.data(), size, size * 64 + 5), size * 64);
+			bits[at / 64] = 0;
+		}
+	}
+}
+
+TEST(BlobUtil, Rotate) {
+	for (size_t size : { 0, 1, 7, 300, 1000, 1537 }) {
+		for (size_t middle : { size_t(0), size_t(1), size / 3, size / 2, size - size / 5, size }) {
+			if (middle > size)
+				continue;
+			vector<int64_t> items(size);
+			for (size_t i = 0; i < size; i++)
+				items[i] = i;
+			auto expected = items;
+			std::rotate(expected.begin(), expected.begin() + middle, expected.end());
+			blob_util::rotate(items.data(), items.data() + middle, items.data() + size);
+			ASSERT_TRUE(items == expected);
+		}
+	}
+}
+
+TEST(BlobUtil, MoveRanges) {
+	auto check = [](size_t size, vector<int64_t> ranges, size_t to) {
+		vector<int64_t> items(size);
+		for (size_t i = 0; i < size; i++)
+			items[i] = i;
+		vector<int64_t> moved, before, after;  // expected result is before + moved + after
+		for (size_t i = 0, r = 0; i < size; i++) {
+			while (r < ranges.size() && size_t(ranges[r + 1]) <= i)
+				r += 2;
+			bool in_range = r < ranges.size() && size_t(ranges[r]) <= i;
+			(in_range ? moved : i < to ? before : after).push_back(i);
+		}
+		before.insert(before.end(), moved.begin(), moved.end());
+		before.insert(before.end(), after.begin(), after.end());
+		ASSERT_TRUE(blob_util::move_ranges(items.data(), size, ranges.data(), ranges.size() / 2, to));
+		ASSERT_TRUE(items == before);
+	};
+	check(10, { 2, 4 }, 8);
+	check(10, { 6, 9 }, 1);
+	check(10, { 0, 2, 5, 6, 8, 10 }, 7);
+	check(10, { 0, 2, 5, 6, 8, 10 }, 3);
+	check(10, { 0, 2, 5, 6, 8, 10 }, 0);
+	check(10, { 0, 2, 5, 6, 8, 10 }, 10);
+	check(10, { 1, 1, 3, 4 }, 3);
+	check(10, {}, 5);
+	check(1000, { 1, 100, 200, 500, 700, 701, 900, 999 }, 600);
+	vector<int64_t> items(10);
+	ASSERT_FALSE(blob_util::move_ranges(items.data(), 10, vector<int64_t>{ 2, 6 }.data(), 1, 4));  // `to` inside range
+	ASSERT_FALSE(blob_util::move_ranges(items.data(), 10, vector<int64_t>{ 5, 6, 2, 3 }.data(), 2, 0));  // unsorted
+	ASSERT_FALSE(blob_util::move_ranges(items.data(), 10, vector<int64_t>{ 5, 11 }.data(), 1, 0));  // out of bounds
+	ASSERT_FALSE(blob_util::move_ranges(items.data(), 10, vector<int64_t>{ 1, 2 }.data(), 1, 11));
+}
+
+TEST(BlobUtil, RadixSort) {
+	// Sizes on both sides of the std::sort fallback, keys with few distinct bytes exercise skipped passes.
+	for (size_t size : { 0, 1, 5, 255, 256, 1000, 5000 }) {
+		for (int64_t seed : { 3, -7 }) {
+			auto items = make_items(size, seed);
+			if (seed < 0) {
+				for (auto& i : items)
+					i = (i & 0xF0F) - 0x800;
+			}
+			auto expected = items;
+			std::sort(expected.begin(), expected.end());
+			blob_util::radix_sort(items.data(), size);
+			ASSERT_TRUE(items == expected);
+		}
+	}
+}
+
+TEST(BlobUtil, SortIndices) {
+	for (size_t size : { 0, 1, 40, 300, 3000 }) {
+		auto keys = make_items(size, 13);
+		for (auto& k : keys)
+			k %= 50;  // lots of duplicates to check stability, both signs
+		auto original = keys;
+		vector<int64_t> expected(size), indices(size);
+		for (size_t i = 0; i < size; i++)
+			expected[i] = i;
+		std::stable_sort(expected.begin(), expected.end(), [&](int64_t a, int64_t b) { return keys[a] < keys[b]; });
+		blob_util::sort_indices(keys.data(), size, indices.data());
+		ASSERT_TRUE(indices == expected);
+		ASSERT_TRUE(keys == original);
+	}
+}
+
+TEST(BlobUtil, Bounds) {
+	for (size_t size = 0; size < max_size; size++) {
+		vector<int64_t> items(size);
+		for (size_t i = 0; i < size; i++)
+			items[i] = int64_t(i / 3) * 2 - 5;  // runs of equal items with gaps between
+		for (int64_t value = -8; value < int64_t(size); value++) {
+			auto lower = size_t(std::lower_bound(items.begin(), items.end(), value) - items.begin());
+			auto upper = size_t(std::upper_bound(items.begin(), items.end(), value) - items.begin());
+			ASSERT_EQ(blob_util::lower_bound(items.data(), size, value), lower);
+			ASSERT_EQ(blob_util::upper_bound(items.data(), size, value), upper);
+		}
+	}
+}
+
+TEST(BlobUtil, Hash) {
+	// Values are pinned, results must not change across kernels, builds and releases.
+	ASSERT_EQ(blob_util::hash("", 0, 0), 0xc869f388ea1641a2ull);
+	ASSERT_EQ(blob_util::hash("hello", 5, 0), 0xb66152b4ca06c1dfull);
+	ASSERT_EQ(blob_util::hash_int(1, 0), 0xacd8a4b553753623ull);
+	vector<char> text(3000);
+	for (size_t i = 0; i < text.size(); i++)
+		text[i] = char(i * 7 + i / 13);
+	ASSERT_EQ(blob_util::hash(text.data(), 1000, 0), 0x68d054c0c23125d7ull);
+	uint64_t combined = 0;  // every size path, and all block and stripe tails of long ones
+	for (size_t size = 0; size <= text.size(); size++)
+		combined = combined * 31 + blob_util::hash(text.data(), size, size % 3);
+	ASSERT_EQ(combined, 0x68d97f55fc7e6317ull);
+
+	vector<char> copy(text.begin() + 1, text.end());  // hashes depend on bytes only, not on alignment
+	for (size_t size : { 3, 15, 100, 700 }) {
+		ASSERT_EQ(blob_util::hash(copy.data(), size, 5), blob_util::hash(text.data() + 1, size, 5));
+		ASSERT_NE(blob_util::hash(text.data(), size, 5), blob_util::hash(text.data(), size, 6));
+		ASSERT_NE(blob_util::hash(text.data(), size, 5), blob_util::hash(text.data(), size + 1, 5));
+		for (size_t at : { size_t(0), size / 2, size - 1 }) {  // every byte matters
+			auto h = blob_util::hash(copy.data(), size, 0);
+			copy[at] ^= 1;
+			ASSERT_NE(blob_util::hash(copy.data(), size, 0), h);
+			copy[at] ^= 1;
+		}
+	}
+	ASSERT_NE(blob_util::hash_int(1, 0), blob_util::hash_int(1, 1));
+	ASSERT_NE(blob_util::hash_int(1, 0), blob_util::hash_int(2, 0));
+}
+
+}  // namespace
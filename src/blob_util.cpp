@@ -0,0 +1,848 @@
+#include "blob_util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BLOB_UTIL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace blob_util {
+
+namespace {
+
+struct Kernels {
+	const char* name;
+	void (*fill)(int64_t* data, size_t count, int64_t value);
+	void (*add)(int64_t* dst, const int64_t* src, size_t count);
+	void (*mul)(int64_t* dst, const int64_t* src, size_t count);
+	int64_t (*sum)(const int64_t* data, size_t count);
+	int64_t (*min)(const int64_t* data, size_t count);
+	int64_t (*max)(const int64_t* data, size_t count);
+	size_t (*count)(const int64_t* data, size_t count, int64_t value);
+	size_t (*mismatch)(const int64_t* a, const int64_t* b, size_t count);
+	size_t (*find)(const int64_t* data, size_t count, int64_t value);
+	size_t (*find_byte)(const uint8_t* data, size_t count, uint8_t value);
+	void (*bit_and)(int64_t* dst, const int64_t* src, size_t count);
+	void (*bit_or)(int64_t* dst, const int64_t* src, size_t count);
+	void (*bit_xor)(int64_t* dst, const int64_t* src, size_t count);
+	void (*bit_andnot)(int64_t* dst, const int64_t* src, size_t count);
+	uint64_t (*popcount)(const int64_t* data, size_t count);
+	size_t (*find_nonzero)(const int64_t* data, size_t count);
+	void (*hash_accumulate)(uint64_t* acc, const char* data, size_t stripes, const uint64_t* key);
+	void (*hash_scramble)(uint64_t* acc, const uint64_t* key);
+};
+
+inline unsigned popcount64(uint64_t v) {
+#ifdef _MSC_VER
+	v -= (v >> 1) & 0x5555555555555555ull;
+	v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+	return unsigned((((v + (v >> 4)) & 0x0F0F0F0F0F0F0F0Full) * 0x0101010101010101ull) >> 56);
+#else
+	return __builtin_popcountll(v);
+#endif
+}
+
+inline unsigned lowest_bit64(uint64_t mask) {  // mask must be non-zero
+#ifdef _MSC_VER
+	unsigned long r;
+#ifdef _M_X64
+	_BitScanForward64(&r, mask);
+#else
+	if (!_BitScanForward(&r, uint32_t(mask))) {
+		_BitScanForward(&r, uint32_t(mask >> 32));
+		r += 32;
+	}
+#endif
+	return r;
+#else
+	return __builtin_ctzll(mask);
+#endif
+}
+
+// Long inputs are hashed XXH3-style: 64-byte stripes go to 8 lanes of 64-bit accumulators,
+// each lane adding the 32x32-bit product of data mixed with a key word, so SIMD kernels compute it exactly
+// as the portable one does. Stripe `j` of a block uses keys shifted by `j` words, blocks end with a scramble.
+const size_t hash_lanes = 8;
+const size_t hash_stripe = hash_lanes * sizeof(uint64_t);  // bytes
+const size_t hash_block_stripes = 8;
+const uint64_t hash_prime32 = 0x9e3779b1u;
+const uint64_t hash_prime64 = 0x9e3779b97f4a7c15ull;
+const uint64_t hash_secret[16] = {  // splitmix64 outputs from zero state
+	0xe220a8397b1dcdafull, 0x6e789e6aa1b965f4ull, 0x06c45d188009454full, 0xf88bb8a8724c81ecull,
+	0x1b39896a51a8749bull, 0x53cb9f0c747ea2eaull, 0x2c829abe1f4532e1ull, 0xc584133ac916ab3cull,
+	0x3ee5789041c98ac3ull, 0xf3b8488c368cb0a6ull, 0x657eecdd3cb13d09ull, 0xc2d326e0055bdef6ull,
+	0x8621a03fe0bbdb7bull, 0x8e1f7555983aa92full, 0xb54e0f1600cc4d19ull, 0x84bb3f97971d80abull };
+
+inline uint64_t load64(const char* p) {  // little-endian hosts only, like blob items
+	uint64_t r;
+	memcpy(&r, p, sizeof(r));
+	return r;
+}
+inline uint64_t load32(const char* p) {
+	uint32_t r;
+	memcpy(&r, p, sizeof(r));
+	return r;
+}
+
+// Portable kernels, also finish the tails left by vector loops.
+namespace generic {
+
+void fill(int64_t* data, size_t count, int64_t value) {
+	for (size_t i = 0; i < count; i++)
+		data[i] = value;
+}
+void add(int64_t* dst, const int64_t* src, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		dst[i] = int64_t(uint64_t(dst[i]) + uint64_t(src[i]));
+}
+void mul(int64_t* dst, const int64_t* src, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		dst[i] = int64_t(uint64_t(dst[i]) * uint64_t(src[i]));
+}
+int64_t sum(const int64_t* data, size_t count) {
+	uint64_t r = 0;
+	for (size_t i = 0; i < count; i++)
+		r += uint64_t(data[i]);
+	return int64_t(r);
+}
+template<bool IS_MAX>
+int64_t extremum(const int64_t* data, size_t count) {
+	int64_t r = data[0];
+	for (size_t i = 1; i < count; i++) {
+		if (IS_MAX ? data[i] > r : data[i] < r)
+			r = data[i];
+	}
+	return r;
+}
+size_t count(const int64_t* data, size_t count, int64_t value) {
+	size_t r = 0;
+	for (size_t i = 0; i < count; i++)
+		r += data[i] == value;
+	return r;
+}
+size_t mismatch(const int64_t* a, const int64_t* b, size_t count) {
+	size_t i = 0;
+	while (i < count && a[i] == b[i])
+		i++;
+	return i;
+}
+size_t find(const int64_t* data, size_t count, int64_t value) {
+	size_t i = 0;
+	while (i < count && data[i] != value)
+		i++;
+	return i;
+}
+size_t find_byte(const uint8_t* data, size_t count, uint8_t value) {
+	size_t i = 0;
+	while (i < count && data[i] != value)
+		i++;
+	return i;
+}
+void bit_and(int64_t* dst, const int64_t* src, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		dst[i] &= src[i];
+}
+void bit_or(int64_t* dst, const int64_t* src, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		dst[i] |= src[i];
+}
+void bit_xor(int64_t* dst, const int64_t* src, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		dst[i] ^= src[i];
+}
+void bit_andnot(int64_t* dst, const int64_t* src, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		dst[i] &= ~src[i];
+}
+uint64_t popcount(const int64_t* data, size_t count) {
+	uint64_t r = 0;
+	for (size_t i = 0; i < count; i++)
+		r += popcount64(uint64_t(data[i]));
+	return r;
+}
+size_t find_nonzero(const int64_t* data, size_t count) {
+	size_t i = 0;
+	while (i < count && !data[i])
+		i++;
+	return i;
+}
+
+void hash_accumulate(uint64_t* acc, const char* data, size_t stripes, const uint64_t* key) {
+	for (; stripes; stripes--, data += hash_stripe, key++) {
+		for (size_t i = 0; i < hash_lanes; i++) {
+			auto d = load64(data + i * sizeof(uint64_t));
+			auto k = d ^ key[i];
+			acc[i ^ 1] += d;
+			acc[i] += (k & 0xffffffffu) * (k >> 32);
+		}
+	}
+}
+void hash_scramble(uint64_t* acc, const uint64_t* key) {
+	for (size_t i = 0; i < hash_lanes; i++)
+		acc[i] = (acc[i] ^ (acc[i] >> 47) ^ key[i]) * hash_prime32;
+}
+
+const Kernels kernels{
+	"generic", fill, add, mul, sum, extremum<false>, extremum<true>, count, mismatch, find, find_byte,
+	bit_and, bit_or, bit_xor, bit_andnot, popcount, find_nonzero, hash_accumulate, hash_scramble };
+
+}  // namespace generic
+
+#ifdef BLOB_UTIL_X86
+
+inline unsigned lowest_bit(uint32_t mask) {
+#ifdef _MSC_VER
+	unsigned long r;
+	_BitScanForward(&r, mask);
+	return r;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// SSE2 is always present on x86-64. It lacks 64-bit compare and multiply,
+// so min, max and mul stay with the portable kernels.
+namespace sse2 {
+
+inline __m128i load(const int64_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline void store(int64_t* p, __m128i v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+inline int64_t horizontal_sum(__m128i v) {
+	int64_t lanes[2];
+	store(lanes, v);
+	return int64_t(uint64_t(lanes[0]) + uint64_t(lanes[1]));
+}
+// All-ones in 64-bit lanes where `a` == `b`, built from 32-bit compares.
+inline __m128i equal64(__m128i a, __m128i b) {
+	auto eq = _mm_cmpeq_epi32(a, b);
+	return _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+inline int equal_mask(__m128i a, __m128i b) {  // bit per 64-bit lane
+	return _mm_movemask_pd(_mm_castsi128_pd(equal64(a, b)));
+}
+
+void fill(int64_t* data, size_t count, int64_t value) {
+	auto v = _mm_set1_epi64x(value);
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2)
+		store(data + i, v);
+	generic::fill(data + i, count - i, value);
+}
+void add(int64_t* dst, const int64_t* src, size_t count) {
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2)
+		store(dst + i, _mm_add_epi64(load(dst + i), load(src + i)));
+	generic::add(dst + i, src + i, count - i);
+}
+int64_t sum(const int64_t* data, size_t count) {
+	auto acc = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2)
+		acc = _mm_add_epi64(acc, load(data + i));
+	return int64_t(uint64_t(horizontal_sum(acc)) + uint64_t(generic::sum(data + i, count - i)));
+}
+size_t count(const int64_t* data, size_t count, int64_t value) {
+	auto v = _mm_set1_epi64x(value);
+	auto acc = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2)
+		acc = _mm_sub_epi64(acc, equal64(load(data + i), v));
+	return size_t(horizontal_sum(acc)) + generic::count(data + i, count - i, value);
+}
+size_t mismatch(const int64_t* a, const int64_t* b, size_t count) {
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		if (int eq = equal_mask(load(a + i), load(b + i)); eq != 3)
+			return i + lowest_bit(~eq & 3);
+	}
+	return i + generic::mismatch(a + i, b + i, count - i);
+}
+size_t find(const int64_t* data, size_t count, int64_t value) {
+	auto v = _mm_set1_epi64x(value);
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		if (int eq = equal_mask(load(data + i), v))
+			return i + lowest_bit(eq);
+	}
+	return i + generic::find(data + i, count - i, value);
+}
+size_t find_byte(const uint8_t* data, size_t count, uint8_t value) {
+	auto v = _mm_set1_epi8(char(value));
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		if (int eq = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, v)))
+			return i + lowest_bit(eq);
+	}
+	return i + generic::find_byte(data + i, count - i, value);
+}
+template<int OP>  // 0 - and, 1 - or, 2 - xor, 3 - andnot
+void bit_op(int64_t* dst, const int64_t* src, size_t count) {
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		auto a = load(dst + i);
+		auto b = load(src + i);
+		store(dst + i,
+			OP == 0 ? _mm_and_si128(a, b) :
+			OP == 1 ? _mm_or_si128(a, b) :
+			OP == 2 ? _mm_xor_si128(a, b) :
+			_mm_andnot_si128(b, a));
+	}
+	auto tail = OP == 0 ? generic::bit_and : OP == 1 ? generic::bit_or : OP == 2 ? generic::bit_xor : generic::bit_andnot;
+	tail(dst + i, src + i, count - i);
+}
+size_t find_nonzero(const int64_t* data, size_t count) {
+	auto zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		if (int eq = equal_mask(load(data + i), zero); eq != 3)
+			return i + lowest_bit(~eq & 3);
+	}
+	return i + generic::find_nonzero(data + i, count - i);
+}
+
+// 32x32-bit products are what SSE2 multiplies natively, the swap of neighbor lanes is a shuffle.
+void hash_accumulate(uint64_t* acc, const char* data, size_t stripes, const uint64_t* key) {
+	__m128i a[hash_lanes / 2];
+	for (size_t i = 0; i < hash_lanes / 2; i++)
+		a[i] = load(reinterpret_cast<int64_t*>(acc) + i * 2);
+	for (; stripes; stripes--, data += hash_stripe, key++) {
+		for (size_t i = 0; i < hash_lanes / 2; i++) {
+			auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data) + i);
+			auto k = _mm_xor_si128(d, load(reinterpret_cast<const int64_t*>(key) + i * 2));
+			a[i] = _mm_add_epi64(a[i], _mm_mul_epu32(k, _mm_srli_epi64(k, 32)));
+			a[i] = _mm_add_epi64(a[i], _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)));
+		}
+	}
+	for (size_t i = 0; i < hash_lanes / 2; i++)
+		store(reinterpret_cast<int64_t*>(acc) + i * 2, a[i]);
+}
+void hash_scramble(uint64_t* acc, const uint64_t* key) {
+	auto prime = _mm_set1_epi32(int(hash_prime32));
+	for (size_t i = 0; i < hash_lanes; i += 2) {
+		auto v = load(reinterpret_cast<int64_t*>(acc + i));
+		v = _mm_xor_si128(_mm_xor_si128(v, _mm_srli_epi64(v, 47)), load(reinterpret_cast<const int64_t*>(key + i)));
+		auto high = _mm_slli_epi64(_mm_mul_epu32(_mm_srli_epi64(v, 32), prime), 32);
+		store(reinterpret_cast<int64_t*>(acc + i), _mm_add_epi64(_mm_mul_epu32(v, prime), high));
+	}
+}
+
+const Kernels kernels{
+	"sse2", fill, add, generic::mul, sum, generic::extremum<false>, generic::extremum<true>, count, mismatch, find, find_byte,
+	bit_op<0>, bit_op<1>, bit_op<2>, bit_op<3>, generic::popcount, find_nonzero, hash_accumulate, hash_scramble };
+
+}  // namespace sse2
+
+namespace avx2 {
+
+AVX2_TARGET inline __m256i load(const int64_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+AVX2_TARGET inline void store(int64_t* p, __m256i v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+AVX2_TARGET inline int64_t horizontal_sum(__m256i v) {
+	int64_t lanes[4];
+	store(lanes, v);
+	return int64_t(uint64_t(lanes[0]) + uint64_t(lanes[1]) + uint64_t(lanes[2]) + uint64_t(lanes[3]));
+}
+AVX2_TARGET inline int equal_mask(__m256i a, __m256i b) {  // bit per 64-bit lane
+	return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, b)));
+}
+
+AVX2_TARGET void fill(int64_t* data, size_t count, int64_t value) {
+	auto v = _mm256_set1_epi64x(value);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		store(data + i, v);
+	generic::fill(data + i, count - i, value);
+}
+AVX2_TARGET void add(int64_t* dst, const int64_t* src, size_t count) {
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		store(dst + i, _mm256_add_epi64(load(dst + i), load(src + i)));
+	generic::add(dst + i, src + i, count - i);
+}
+AVX2_TARGET void mul(int64_t* dst, const int64_t* src, size_t count) {
+	// There is no 64-bit multiply below AVX-512: lo*lo + ((lo*hi + hi*lo) << 32).
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		auto a = load(dst + i);
+		auto b = load(src + i);
+		auto cross = _mm256_add_epi64(
+			_mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)),
+			_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b));
+		store(dst + i, _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32)));
+	}
+	generic::mul(dst + i, src + i, count - i);
+}
+AVX2_TARGET int64_t sum(const int64_t* data, size_t count) {
+	auto acc = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		acc = _mm256_add_epi64(acc, load(data + i));
+	return int64_t(uint64_t(horizontal_sum(acc)) + uint64_t(generic::sum(data + i, count - i)));
+}
+template<bool IS_MAX>
+AVX2_TARGET int64_t extremum(const int64_t* data, size_t count) {
+	if (count < 8)
+		return generic::extremum<IS_MAX>(data, count);
+	auto acc = load(data);
+	size_t i = 4;
+	for (; i + 4 <= count; i += 4) {
+		auto v = load(data + i);
+		acc = _mm256_blendv_epi8(acc, v, IS_MAX ? _mm256_cmpgt_epi64(v, acc) : _mm256_cmpgt_epi64(acc, v));
+	}
+	int64_t lanes[4];
+	store(lanes, acc);
+	auto r = generic::extremum<IS_MAX>(lanes, 4);
+	if (i < count) {
+		auto tail = generic::extremum<IS_MAX>(data + i, count - i);
+		r = IS_MAX ? (tail > r ? tail : r) : (tail < r ? tail : r);
+	}
+	return r;
+}
+AVX2_TARGET size_t count(const int64_t* data, size_t count, int64_t value) {
+	auto v = _mm256_set1_epi64x(value);
+	auto acc = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		acc = _mm256_sub_epi64(acc, _mm256_cmpeq_epi64(load(data + i), v));
+	return size_t(horizontal_sum(acc)) + generic::count(data + i, count - i, value);
+}
+AVX2_TARGET size_t mismatch(const int64_t* a, const int64_t* b, size_t count) {
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		if (int eq = equal_mask(load(a + i), load(b + i)); eq != 15)
+			return i + lowest_bit(~eq & 15);
+	}
+	return i + generic::mismatch(a + i, b + i, count - i);
+}
+AVX2_TARGET size_t find(const int64_t* data, size_t count, int64_t value) {
+	auto v = _mm256_set1_epi64x(value);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		if (int eq = equal_mask(load(data + i), v))
+			return i + lowest_bit(eq);
+	}
+	return i + generic::find(data + i, count - i, value);
+}
+AVX2_TARGET size_t find_byte(const uint8_t* data, size_t count, uint8_t value) {
+	auto v = _mm256_set1_epi8(char(value));
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32) {
+		auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		if (uint32_t eq = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, v))))
+			return i + lowest_bit(eq);
+	}
+	return i + sse2::find_byte(data + i, count - i, value);
+}
+template<int OP>  // 0 - and, 1 - or, 2 - xor, 3 - andnot
+AVX2_TARGET void bit_op(int64_t* dst, const int64_t* src, size_t count) {
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		auto a = load(dst + i);
+		auto b = load(src + i);
+		store(dst + i,
+			OP == 0 ? _mm256_and_si256(a, b) :
+			OP == 1 ? _mm256_or_si256(a, b) :
+			OP == 2 ? _mm256_xor_si256(a, b) :
+			_mm256_andnot_si256(b, a));
+	}
+	auto tail = OP == 0 ? generic::bit_and : OP == 1 ? generic::bit_or : OP == 2 ? generic::bit_xor : generic::bit_andnot;
+	tail(dst + i, src + i, count - i);
+}
+AVX2_TARGET uint64_t popcount(const int64_t* data, size_t count) {
+	// Nibble lookup with vpshufb, byte counts summed to 64-bit lanes by vpsadbw.
+	// On long runs it outpaces one scalar popcnt per word.
+	const auto lut = _mm256_setr_epi8(
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const auto low_nibbles = _mm256_set1_epi8(0x0F);
+	auto acc = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		auto v = load(data + i);
+		auto counts = _mm256_add_epi8(
+			_mm256_shuffle_epi8(lut, _mm256_and_si256(v, low_nibbles)),
+			_mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles)));
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+	}
+	return uint64_t(horizontal_sum(acc)) + generic::popcount(data + i, count - i);
+}
+AVX2_TARGET size_t find_nonzero(const int64_t* data, size_t count) {
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		auto v = load(data + i);
+		if (!_mm256_testz_si256(v, v))
+			return i + lowest_bit(~equal_mask(v, _mm256_setzero_si256()) & 15);
+	}
+	return i + generic::find_nonzero(data + i, count - i);
+}
+
+AVX2_TARGET inline __m256i hash_step(__m256i acc, const char* data, const uint64_t* key) {  // 4 lanes
+	auto d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+	auto k = _mm256_xor_si256(d, load(reinterpret_cast<const int64_t*>(key)));
+	acc = _mm256_add_epi64(acc, _mm256_mul_epu32(k, _mm256_srli_epi64(k, 32)));
+	return _mm256_add_epi64(acc, _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+AVX2_TARGET void hash_accumulate(uint64_t* acc, const char* data, size_t stripes, const uint64_t* key) {
+	auto a0 = load(reinterpret_cast<int64_t*>(acc));
+	auto a1 = load(reinterpret_cast<int64_t*>(acc) + 4);
+	for (; stripes; stripes--, data += hash_stripe, key++) {
+		a0 = hash_step(a0, data, key);
+		a1 = hash_step(a1, data + 32, key + 4);
+	}
+	store(reinterpret_cast<int64_t*>(acc), a0);
+	store(reinterpret_cast<int64_t*>(acc) + 4, a1);
+}
+AVX2_TARGET void hash_scramble(uint64_t* acc, const uint64_t* key) {
+	auto prime = _mm256_set1_epi32(int(hash_prime32));
+	for (size_t i = 0; i < hash_lanes; i += 4) {
+		auto v = load(reinterpret_cast<int64_t*>(acc + i));
+		v = _mm256_xor_si256(_mm256_xor_si256(v, _mm256_srli_epi64(v, 47)), load(reinterpret_cast<const int64_t*>(key + i)));
+		auto high = _mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(v, 32), prime), 32);
+		store(reinterpret_cast<int64_t*>(acc + i), _mm256_add_epi64(_mm256_mul_epu32(v, prime), high));
+	}
+}
+
+const Kernels kernels{
+	"avx2", fill, add, mul, sum, extremum<false>, extremum<true>, count, mismatch, find, find_byte,
+	bit_op<0>, bit_op<1>, bit_op<2>, bit_op<3>, popcount, find_nonzero, hash_accumulate, hash_scramble };
+
+}  // namespace avx2
+
+bool has_avx2() {
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 0);
+	if (regs[0] < 7)
+		return false;
+	__cpuid(regs, 1);
+	bool os_saves_ymm = (regs[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+	__cpuidex(regs, 7, 0);
+	return os_saves_ymm && (regs[1] & (1 << 5));
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+const Kernels* best_kernels() {
+	return has_avx2() ? &avx2::kernels : &sse2::kernels;
+}
+
+#else
+
+const Kernels* best_kernels() {
+	return &generic::kernels;
+}
+
+#endif  // BLOB_UTIL_X86
+
+const Kernels* const active = best_kernels();
+
+// Below this count std::sort beats the fixed cost of radix histograms.
+const size_t radix_sort_threshold = 256;
+
+// Radix keys are items with the sign bit flipped, so that unsigned byte order matches signed item order.
+const uint64_t sign_bit = uint64_t(1) << 63;
+
+struct KeyIndex {
+	uint64_t key;
+	int64_t index;
+};
+inline uint64_t key_of(uint64_t item) { return item; }
+inline uint64_t key_of(const KeyIndex& item) { return item.key; }
+
+// Stable LSD radix sort of `count` items from `a`, using `b` as scratch. Returns whichever of them holds the result.
+// 11-bit digits take 6 passes where bytes would take 8, the 6 histograms still fit in L2.
+// Histograms of all digits are gathered in a single sweep, so each pass after it is a pure scatter.
+const int radix_bits = 11;
+const int radix_passes_count = (64 + radix_bits - 1) / radix_bits;
+const size_t radix_size = size_t(1) << radix_bits;
+
+inline size_t digit(uint64_t key, int pass) { return (key >> (pass * radix_bits)) & (radix_size - 1); }
+
+template<typename T>
+T* radix_passes(T* a, T* b, size_t count) {
+	std::vector<size_t> counts(radix_passes_count * radix_size);
+	for (size_t i = 0; i < count; i++) {
+		uint64_t key = key_of(a[i]);
+		for (int pass = 0; pass < radix_passes_count; pass++)
+			counts[pass * radix_size + digit(key, pass)]++;
+	}
+	for (int pass = 0; pass < radix_passes_count; pass++) {
+		size_t* offsets = counts.data() + pass * radix_size;
+		if (offsets[digit(key_of(a[0]), pass)] == count)
+			continue;  // all items share this digit
+		for (size_t i = 0, at = 0; i < radix_size; i++) {
+			size_t n = offsets[i];
+			offsets[i] = at;
+			at += n;
+		}
+		for (size_t i = 0; i < count; i++)
+			b[offsets[digit(key_of(a[i]), pass)]++] = a[i];
+		std::swap(a, b);
+	}
+	return a;
+}
+
+inline void prefetch(const int64_t* p) {
+#if defined(_MSC_VER) && defined(BLOB_UTIL_X86)
+	_mm_prefetch(reinterpret_cast<const char*>(p), _MM_HINT_T0);
+#elif defined(__GNUC__)
+	__builtin_prefetch(p);
+#else
+	(void)p;
+#endif
+}
+
+// The search range halves on every step whatever the comparison gives, so the loop has a fixed trip count
+// and the comparison turns into a conditional move instead of a mispredicted branch.
+// Both midpoints of the next step are prefetched, since the move hides which one will be needed.
+template<bool UPPER>
+size_t bound(const int64_t* data, size_t count, int64_t value) {
+	if (count == 0)
+		return 0;
+	auto base = data;
+	for (size_t n = count; n > 1; n -= n / 2) {
+		size_t half = n / 2;
+		prefetch(base + (n - half) / 2);
+		prefetch(base + half + (n - half) / 2);
+		base = (UPPER ? base[half] <= value : base[half] < value) ? base + half : base;
+	}
+	return (base - data) + (UPPER ? *base <= value : *base < value);
+}
+
+inline uint64_t mum(uint64_t a, uint64_t b) {  // 128-bit product folded to 64 bits
+#ifdef __SIZEOF_INT128__
+	auto r = static_cast<unsigned __int128>(a) * b;
+	return uint64_t(r) ^ uint64_t(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	uint64_t high;
+	auto low = _umul128(a, b, &high);
+	return low ^ high;
+#else
+	uint64_t a0 = uint32_t(a), a1 = a >> 32, b0 = uint32_t(b), b1 = b >> 32;
+	uint64_t mid = (a0 * b0 >> 32) + uint32_t(a1 * b0) + uint32_t(a0 * b1);
+	uint64_t high = a1 * b1 + (a1 * b0 >> 32) + (a0 * b1 >> 32) + (mid >> 32);
+	return (a * b) ^ high;
+#endif
+}
+
+inline uint64_t avalanche(uint64_t h) {
+	h ^= h >> 37;
+	h *= 0x165667919e3779f9ull;
+	return h ^ (h >> 32);
+}
+
+uint64_t hash_long(const char* data, size_t size, const uint64_t* key) {  // size > hash_stripe
+	uint64_t acc[hash_lanes];
+	memcpy(acc, hash_secret, sizeof(acc));
+	size_t stripes = (size - 1) / hash_stripe;  // the last stripe, full or not, is hashed apart
+	auto p = data;
+	for (size_t blocks = stripes / hash_block_stripes; blocks; blocks--, p += hash_stripe * hash_block_stripes) {
+		active->hash_accumulate(acc, p, hash_block_stripes, key);
+		active->hash_scramble(acc, key + hash_lanes);
+	}
+	active->hash_accumulate(acc, p, stripes % hash_block_stripes, key);
+	active->hash_accumulate(acc, data + size - hash_stripe, 1, key + hash_lanes);
+	uint64_t h = size * hash_prime64;
+	for (size_t i = 0; i < hash_lanes; i += 2)
+		h += mum(acc[i] ^ key[i], acc[i + 1] ^ key[i + 1]);
+	return avalanche(h);
+}
+
+}  // namespace
+
+void rotate(int64_t* first, int64_t* middle, int64_t* last) {
+	// Block swap: swapping the shorter side with its counterpart reduces the rotation to a smaller one.
+	// All passes are sequential memcpy/memmove through a stack buffer, where std::rotate jumps across the range.
+	const size_t buffer_size = 1024;
+	int64_t buffer[buffer_size];
+	auto swap_blocks = [&](int64_t* a, int64_t* b, size_t count) {
+		for (size_t chunk; count; a += chunk, b += chunk, count -= chunk) {
+			chunk = std::min(count, buffer_size);
+			memcpy(buffer, a, sizeof(int64_t) * chunk);
+			memcpy(a, b, sizeof(int64_t) * chunk);
+			memcpy(b, buffer, sizeof(int64_t) * chunk);
+		}
+	};
+	for (;;) {
+		size_t left = middle - first;
+		size_t right = last - middle;
+		if (left == 0 || right == 0)
+			return;
+		if (left <= buffer_size) {
+			memcpy(buffer, first, sizeof(int64_t) * left);
+			memmove(first, middle, sizeof(int64_t) * right);
+			memcpy(first + right, buffer, sizeof(int64_t) * left);
+			return;
+		}
+		if (right <= buffer_size) {
+			memcpy(buffer, middle, sizeof(int64_t) * right);
+			memmove(first + right, first, sizeof(int64_t) * left);
+			memcpy(first, buffer, sizeof(int64_t) * right);
+			return;
+		}
+		if (left <= right) {
+			swap_blocks(first, middle, left);
+			first = middle;
+			middle += left;
+		} else {
+			swap_blocks(middle - right, middle, right);
+			last -= right;
+			middle -= right;
+		}
+	}
+}
+
+bool move_ranges(int64_t* data, size_t size, const int64_t* ranges, size_t range_count, size_t to) {
+	if (to > size)
+		return false;
+	size_t split = 0;  // ranges[0..split) are before `to`
+	for (size_t i = 0, prev_end = 0; i < range_count; i++) {
+		auto begin = uint64_t(ranges[i * 2]);
+		auto end = uint64_t(ranges[i * 2 + 1]);
+		if (begin < prev_end || begin > end || end > size || (begin < to && to < end))
+			return false;
+		prev_end = end;
+		if (end <= to)
+			split = i + 1;
+	}
+	// Ranges before `to` are gathered into a block that rolls right, each rotation moves the block over the next gap.
+	size_t block_begin = to, block_end = to;
+	for (size_t i = 0; i < split; i++) {
+		auto begin = size_t(ranges[i * 2]);
+		auto end = size_t(ranges[i * 2 + 1]);
+		if (i == 0) {
+			block_begin = begin;
+		} else {
+			rotate(data + block_begin, data + block_end, data + begin);
+			block_begin += begin - block_end;
+		}
+		block_end = end;
+	}
+	if (split)
+		rotate(data + block_begin, data + block_end, data + to);
+	// Ranges after `to` roll left the same way.
+	block_begin = block_end = to;
+	for (size_t i = range_count; i > split; i--) {
+		auto begin = size_t(ranges[i * 2 - 2]);
+		auto end = size_t(ranges[i * 2 - 1]);
+		if (i == range_count) {
+			block_end = end;
+		} else {
+			rotate(data + end, data + block_begin, data + block_end);
+			block_end -= block_begin - end;
+		}
+		block_begin = begin;
+	}
+	if (split < range_count)
+		rotate(data + to, data + block_begin, data + block_end);
+	return true;
+}
+
+void radix_sort(int64_t* data, size_t count) {
+	if (count < radix_sort_threshold) {
+		std::sort(data, data + count);
+		return;
+	}
+	auto keys = reinterpret_cast<uint64_t*>(data);
+	std::vector<uint64_t> scratch(count);
+	for (size_t i = 0; i < count; i++)
+		keys[i] ^= sign_bit;
+	auto sorted = radix_passes(keys, scratch.data(), count);
+	for (size_t i = 0; i < count; i++)
+		keys[i] = sorted[i] ^ sign_bit;
+}
+
+void sort_indices(const int64_t* keys, size_t count, int64_t* indices) {
+	if (count < radix_sort_threshold) {
+		for (size_t i = 0; i < count; i++)
+			indices[i] = int64_t(i);
+		std::stable_sort(indices, indices + count, [keys](int64_t a, int64_t b) { return keys[a] < keys[b]; });
+		return;
+	}
+	std::vector<KeyIndex> items(count * 2);
+	for (size_t i = 0; i < count; i++)
+		items[i] = { uint64_t(keys[i]) ^ sign_bit, int64_t(i) };
+	auto sorted = radix_passes(items.data(), items.data() + count, count);
+	for (size_t i = 0; i < count; i++)
+		indices[i] = sorted[i].index;
+}
+
+size_t lower_bound(const int64_t* data, size_t count, int64_t value) { return bound<false>(data, count, value); }
+size_t upper_bound(const int64_t* data, size_t count, int64_t value) { return bound<true>(data, count, value); }
+
+void fill(int64_t* data, size_t count, int64_t value) { active->fill(data, count, value); }
+void add(int64_t* dst, const int64_t* src, size_t count) { active->add(dst, src, count); }
+void mul(int64_t* dst, const int64_t* src, size_t count) { active->mul(dst, src, count); }
+int64_t sum(const int64_t* data, size_t count) { return active->sum(data, count); }
+int64_t min(const int64_t* data, size_t count) { return active->min(data, count); }
+int64_t max(const int64_t* data, size_t count) { return active->max(data, count); }
+size_t count(const int64_t* data, size_t count, int64_t value) { return active->count(data, count, value); }
+size_t mismatch(const int64_t* a, const int64_t* b, size_t count) { return active->mismatch(a, b, count); }
+size_t find(const int64_t* data, size_t count, int64_t value) { return active->find(data, count, value); }
+size_t find_byte(const uint8_t* data, size_t count, uint8_t value) { return active->find_byte(data, count, value); }
+void bit_and(int64_t* dst, const int64_t* src, size_t count) { active->bit_and(dst, src, count); }
+void bit_or(int64_t* dst, const int64_t* src, size_t count) { active->bit_or(dst, src, count); }
+void bit_xor(int64_t* dst, const int64_t* src, size_t count) { active->bit_xor(dst, src, count); }
+void bit_andnot(int64_t* dst, const int64_t* src, size_t count) { active->bit_andnot(dst, src, count); }
+uint64_t popcount(const int64_t* data, size_t count) { return active->popcount(data, count); }
+uint64_t find_set_bit(const int64_t* data, size_t count, uint64_t from) {
+	auto word = from / 64;
+	if (word >= count)
+		return count * 64;
+	if (auto first = uint64_t(data[word]) & (~uint64_t(0) << (from % 64)))
+		return word * 64 + lowest_bit64(first);
+	word++;
+	word += active->find_nonzero(data + word, count - word);
+	return word < count ? word * 64 + lowest_bit64(uint64_t(data[word])) : count * 64;
+}
+const char* kernels_name() { return active->name; }
+
+uint64_t hash(const void* data, size_t size, uint64_t seed) {
+	auto p = static_cast<const char*>(data);
+	auto key = [&](size_t i) { return hash_secret[i] + seed; };
+	if (size > 128) {
+		uint64_t keys[16];
+		for (size_t i = 0; i < 16; i++)
+			keys[i] = key(i);
+		return hash_long(p, size, keys);
+	}
+	uint64_t h = size * hash_prime64;
+	if (size > 16) {  // 16-byte chunks with keys by position, the last one overlaps its predecessor
+		for (size_t i = 0, k = 0; i + 16 < size; i += 16, k += 2)
+			h += mum(load64(p + i) ^ key(k), load64(p + i + 8) ^ key(k + 1));
+		return avalanche(h + mum(load64(p + size - 16) ^ key(14), load64(p + size - 8) ^ key(15)));
+	}
+	uint64_t a = 0, b = 0;  // up to 16 bytes as two words, from overlapping reads
+	if (size >= 8) {
+		a = load64(p);
+		b = load64(p + size - 8);
+	} else if (size >= 4) {
+		a = load32(p);
+		b = load32(p + size - 4);
+	} else if (size) {
+		a = uint64_t(uint8_t(p[0])) << 16 | uint64_t(uint8_t(p[size / 2])) << 8 | uint8_t(p[size - 1]);
+	}
+	return avalanche(h + mum(a ^ key(0), b ^ key(1)));
+}
+
+uint64_t hash_int(int64_t value, uint64_t seed) {
+	// rrmxmx mixer, a bijection of `value` for any seed.
+	auto v = uint64_t(value) ^ (hash_secret[0] + seed);
+	v ^= (v >> 49 | v << 15) ^ (v >> 24 | v << 40);
+	v *= 0x9fb21c651e98df25ull;
+	v ^= v >> 28;
+	v *= 0x9fb21c651e98df25ull;
+	return v ^ (v >> 28);
+}
+
+}  // namespace blob_util
@@ -0,0 +1,67 @@
+#ifndef _BLOB_UTIL_H_
+#define _BLOB_UTIL_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Bulk operations on blob items.
+// Each call is routed to AVX2 or SSE2 kernels selected once by CPU feature detection,
+// with a portable fallback on non-x86 targets.
+namespace blob_util {
+
+void fill(int64_t* data, size_t count, int64_t value);
+void add(int64_t* dst, const int64_t* src, size_t count);  // dst[i] += src[i], wrapping
+void mul(int64_t* dst, const int64_t* src, size_t count);  // dst[i] *= src[i], wrapping
+int64_t sum(const int64_t* data, size_t count);  // wrapping
+int64_t min(const int64_t* data, size_t count);  // count must be > 0
+int64_t max(const int64_t* data, size_t count);  // count must be > 0
+size_t count(const int64_t* data, size_t count, int64_t value);
+
+// These return `count` if nothing found.
+size_t mismatch(const int64_t* a, const int64_t* b, size_t count);
+size_t find(const int64_t* data, size_t count, int64_t value);
+size_t find_byte(const uint8_t* data, size_t count, uint8_t value);
+
+// Moves items [middle, last) in front of [first, middle) in place, without heap allocations.
+void rotate(int64_t* first, int64_t* middle, int64_t* last);
+
+// Moves items of `range_count` [begin, end) index pairs from `ranges` to index `to`,
+// keeping their order and the order of the other items. Ranges must be sorted and disjoint,
+// `to` must not be inside any range. Works in place in a single sweep. Returns false on bad ranges.
+bool move_ranges(int64_t* data, size_t size, const int64_t* ranges, size_t range_count, size_t to);
+
+// Bitwise dst[i] &= src[i], |=, ^= and &= ~src[i].
+void bit_and(int64_t* dst, const int64_t* src, size_t count);
+void bit_or(int64_t* dst, const int64_t* src, size_t count);
+void bit_xor(int64_t* dst, const int64_t* src, size_t count);
+void bit_andnot(int64_t* dst, const int64_t* src, size_t count);
+uint64_t popcount(const int64_t* data, size_t count);  // set bits in all items
+// Index of the first set bit at or after bit `from`, bit `i` being bit `i % 64` of item `i / 64`.
+// Returns `count * 64` if none.
+uint64_t find_set_bit(const int64_t* data, size_t count, uint64_t from);
+
+// Sorts items ascending. LSD radix sort over 11-bit digits, passes on digits shared by all items are skipped.
+// Small counts fall back to std::sort.
+void radix_sort(int64_t* data, size_t count);
+
+// Stores to `indices` the permutation of 0..count-1 that orders `keys` ascending,
+// equal keys keep their original order. `keys` is left unchanged.
+void sort_indices(const int64_t* keys, size_t count, int64_t* indices);
+
+// Binary search in sorted items without data-dependent branches.
+// Return the index of the first item >= `value` (lower) or > `value` (upper), `count` if none.
+size_t lower_bound(const int64_t* data, size_t count, int64_t value);
+size_t upper_bound(const int64_t* data, size_t count, int64_t value);
+
+// Non-cryptographic 64-bit hash of bytes, for dedup, sharding and hash tables. Results are stable:
+// they don't depend on kernels, build or run, so the host and compiled programs can share them.
+// Long inputs are hashed by SIMD kernels at memory speed.
+uint64_t hash(const void* data, size_t size, uint64_t seed);
+uint64_t hash_int(int64_t value, uint64_t seed);  // a bijection of `value` for any seed
+
+// "avx2", "sse2" or "generic", for diagnostics and tests.
+const char* kernels_name();
+
+}  // namespace blob_util
+
+#endif  // _BLOB_UTIL_H_
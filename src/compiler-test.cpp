@@ -1,4 +1,5 @@
 #include <unordered_map>
+#include <cstdio>
 #include "fake-gunit.h"
 #include "ast.h"
 #include "parser.h"
@@ -7,6 +8,7 @@
 #include "type-checker.h"
 
 int64_t generate_and_execute(ltm::pin<ast::Ast> ast, bool dump_ir);  // defined in `generator.h/cpp`
+void set_heap_image_path(std::string path);  // defined in `generator.h/cpp`
 
 namespace {
 
@@ -33,6 +35,15 @@ int64_t execute(const char* source_text, bool dump_all = false) {
     return generate_and_execute(ast, dump_all);
 }
 
+bool rejected(const char* source_text) {  // compile errors are thrown by Node::err_out
+    try {
+        execute(source_text);
+    } catch (int) {
+        return true;
+    }
+    return false;
+}
+
 
 
 
@@ -83,6 +94,674 @@ TEST(Parser, BlobsAndIndexes) {
     )"));
 }
 
+TEST(Parser, BlobGrowth) {
+    ASSERT_EQ(20010989, execute(R"(
+        b = sys_Blob;
+        sys_Container_reserve(b, 10);
+        i = 0;
+        loop {
+            sys_Container_insert(b, i, 1);
+            b[i] := i;
+            i := i + 1;
+            i == 1000 ? 0
+        };
+        sys_Blob_delete(b, 10, 980);
+        sys_Container_shrink(b);
+        sys_Container_size(b) * 1000000 + b[9] * 1000 + b[10] + b[19]
+    )"));
+}
+
+TEST(Parser, SmallContainers) {
+    ASSERT_EQ(578, execute(R"(
+        class Node {
+            x = 1;
+        }
+        a = sys_Array;
+        sys_Container_insert(a, 0, 3);
+        a[0] := Node;
+        a[2] := Node;
+        a[2]&&_~Node?_.x := 5;
+        c = @a;
+        sys_Container_insert(c, 3, 10);
+        c[12] := Node;
+        sys_Array_delete(c, 3, 10);
+        b = sys_Blob;
+        sys_Container_insert(b, 0, 4);
+        b[3] := 7;
+        d = @b;
+        d[3] := 8;
+        (c[2]&&_~Node?_.x : 0) * 100 + b[3] * 10 + d[3]
+    )"));
+}
+
+TEST(Parser, BlobBulkOps) {
+    ASSERT_EQ(1, execute(R"(
+        a = sys_Blob;
+        sys_Container_insert(a, 0, 20);
+        sys_Blob_fill(a, 0, 100, 3);
+        sys_Blob_fill(a, 5, 2, -4);
+        a[17] := 9;
+        b = @a;
+        sys_Blob_add(b, a);
+        sys_Blob_mul(b, a);
+        c = @a;
+        c[18] := 0;
+        d = @a;
+        sys_Blob_sum(a) == 3 * 17 - 8 + 9 &&
+        sys_Blob_min(a) == -4 &&
+        sys_Blob_max(b) == 162 &&
+        sys_Blob_count(a, 3) == 17 &&
+        sys_Blob_findInt(a, 0, 9) == 17 &&
+        sys_Blob_findInt(a, 18, 9) == -1 &&
+        sys_Blob_findByte(a, 0, 9) == 17 * 8 &&
+        sys_Blob_compare(a, b) == -1 &&
+        sys_Blob_compare(a, c) == 1 &&
+        sys_Blob_compare(a, d) == 0 &&
+        sys_Blob_copy(c, 1, a, 17 * 8, 8) &&
+        sys_Blob_findByte(c, 0, 9) == 1 ? 1 : 0
+    )"));
+}
+
+TEST(Parser, BlobSortAndSearch) {
+    ASSERT_EQ(1, execute(R"(
+        a = sys_Blob;
+        sys_Container_insert(a, 0, 1000);
+        i = 0;
+        loop {
+            a[i] := i * 7919 % 1000 - 500;
+            a[i + 1] := 3;
+            i := i + 2;
+            i == 1000 ? 0
+        };
+        keys = @a;
+        idx = sys_Blob;
+        sys_Container_insert(idx, 0, 1000);
+        short = sys_Blob;
+        sys_Container_insert(short, 0, 3);
+        sys_Blob_sort(a);
+        sys_Blob_sortIndices(keys, idx) &&
+        (sys_Blob_sortIndices(keys, short) ? 0 : 1) == 1 &&
+        a[0] == -500 &&
+        a[999] == 498 &&
+        keys[0] == -500 &&
+        keys[idx[0]] == -500 &&
+        keys[idx[999]] == 498 &&
+        idx[sys_Blob_lowerBound(a, 3)] == 1 &&
+        sys_Blob_upperBound(a, 3) - sys_Blob_lowerBound(a, 3) == 500 &&
+        sys_Blob_lowerBound(a, 10000) == 1000 &&
+        sys_Blob_upperBound(a, -10000) == 0 ? 1 : 0
+    )"));
+}
+
+TEST(Parser, BlobHash) {
+    ASSERT_EQ(1, execute(R"(
+        a = sys_Blob;
+        sys_Container_insert(a, 0, 3);
+        sys_Blob_setByteAt(a, 3, 104);
+        sys_Blob_setByteAt(a, 4, 101);
+        sys_Blob_setByteAt(a, 5, 108);
+        sys_Blob_setByteAt(a, 6, 108);
+        sys_Blob_setByteAt(a, 7, 111);
+        sys_Blob_hash(a, 3, 5, 0) == -5304867949628702241 &&
+        sys_Blob_hash(a, 3, 5, 1) != sys_Blob_hash(a, 3, 5, 0) &&
+        sys_Blob_hash(a, 24, 5, 0) == sys_Blob_hash(a, 100, 0, 0) &&
+        sys_Blob_hashInt(1, 0) == -5991858205520218589 &&
+        sys_Blob_hashInt(1, 0) != sys_Blob_hashInt(2, 0) ? 1 : 0
+    )"));
+}
+
+TEST(Parser, Bitset) {
+    ASSERT_EQ(100501511013, execute(R"(
+        a = sys_Bitset;
+        b = sys_Bitset;
+        i = 0;
+        loop {
+            sys_Bitset_set(a, i);
+            sys_Bitset_set(b, i * 2);
+            i := i + 3;
+            i > 300 ? 0
+        };
+        sys_Bitset_clear(a, 0);
+        c = @a;
+        sys_Bitset_and(c, b);
+        o = @a;
+        sys_Bitset_or(o, b);
+        x = @a;
+        sys_Bitset_xor(x, b);
+        n = @a;
+        sys_Bitset_andNot(n, b);
+        sys_Bitset_popcount(a) * 1000000000 +
+            sys_Bitset_popcount(c) * 10000000 +
+            sys_Bitset_popcount(o) * 10000 +
+            sys_Bitset_popcount(x) * 10 +
+            (sys_Bitset_test(a, 3) && !sys_Bitset_test(a, 4) && !sys_Bitset_test(a, 100000) ? 1 : 0) +
+            (sys_Bitset_findNext(n, 0) == 3 && sys_Bitset_findNext(c, 7) == 12 && sys_Bitset_findNext(a, 301) == -1 ? 2 : 0)
+    )"));
+}
+
+TEST(Parser, BlobView) {
+    ASSERT_EQ(11, execute(R"(
+        a = sys_Blob;
+        sys_Container_insert(a, 0, 100);
+        i = 0;
+        loop {
+            a[i] := i;
+            i := i + 1;
+            i == 100 ? 0
+        };
+        v = sys_Blob_view(a, 10, 50);
+        s = sys_Blob_view(a, 95, 10);
+        a[10] := -1;
+        w = sys_Blob_view(v, 40, 20);
+        v[0] := 7;
+        ok = sys_Container_size(v) == 50 && v[0] == 7 && v[1] == 11 && a[10] == -1 &&
+            sys_Container_size(s) == 5 && s[4] == 99 &&
+            sys_Container_size(w) == 10 && w[0] == 50 && sys_Blob_sum(w) == 545 &&
+            sys_Container_size(sys_Blob_view(a, 200, 5)) == 0 ? 1 : 0;
+        a := sys_Blob;
+        ok + (v[49] == 59 && w[9] == 59 ? 10 : 0)
+    )"));
+}
+
+TEST(Parser, BlobCopyOnWrite) {
+    ASSERT_EQ(57131, execute(R"(
+        a = sys_Blob;
+        sys_Container_insert(a, 0, 20);
+        sys_Blob_fill(a, 0, 20, 5);
+        b = @a;
+        c = @a;
+        b[3] := 7;
+        sys_Blob_setByteAt(a, 0, 1);
+        c[19] := 2;
+        sys_Container_insert(c, 0, 1);
+        d = @c;
+        sys_Blob_delete(d, 0, 10);
+        a[3] * 10000 + b[3] * 1000 + a[0] * 100 + c[20] * 10 + sys_Container_size(d)
+    )"));
+}
+
+TEST(Parser, InlineContainerAccess) {
+    ASSERT_EQ(4950260, execute(R"(
+        class Node {
+            x = 5;
+        }
+        b = sys_Blob;
+        sys_Container_insert(b, 0, 100);
+        i = 0;
+        loop {
+            b[i] := i;
+            i := i + 1;
+            i == sys_Container_size(b) ? 0
+        };
+        s = 0;
+        i := 0;
+        loop {
+            s := s + b[i];
+            i := i + 1;
+            i == sys_Container_size(b) ? 0
+        };
+        b[100] := 7;
+        sys_Blob_setByteAt(b, 3, 255);
+        a = sys_Array;
+        sys_Container_insert(a, 0, 1);
+        a[0] := Node;
+        x = a[0] && _~Node ? _.x : 0;
+        y = a[1] && _~Node ? _.x : 0;
+        s * 1000 + b[100] + sys_Blob_getByteAt(b, 3) + sys_Blob_getByteAt(b, 800) + x + y
+    )"));
+}
+
+TEST(Parser, Each) {
+    ASSERT_EQ(495053293, execute(R"(
+        class Node {
+            x = 0;
+        }
+        b = sys_Blob;
+        sys_Container_insert(b, 0, 100);
+        i = 0;
+        loop {
+            b[i] := i;
+            i := i + 1;
+            i == 100 ? 0
+        };
+        s = 0;
+        each(b) v { s := s + v };
+        a = sys_Array;
+        sys_Container_insert(a, 0, 3);
+        a[0] := Node;
+        a[2] := Node;
+        a[2]&&_~Node?_.x := 5;
+        each(a) { _&&_~Node?_.x := _.x + 1 };
+        n = 0;
+        each(a) { n := n + (_&&_~Node?_.x + 1 : 0) };
+        t = 0;
+        each("hello") c { t := t + c };
+        d = sys_Blob;
+        sys_Container_insert(d, 0, 5);
+        k = 0;
+        each(d) { k := k + 1; sys_Blob_delete(d, 0, 1) };
+        s * 100000 + t * 100 + n * 10 + k
+    )"));
+}
+
+TEST(Parser, BlobMapFile) {
+    if (auto f = std::fopen("map-file-test.bin", "wb")) {
+        const int64_t items[] = { 5, 7 };
+        const char tail[] = { 1, 2, 3 };
+        std::fwrite(items, sizeof(items), 1, f);
+        std::fwrite(tail, sizeof(tail), 1, f);
+        std::fclose(f);
+    }
+    ASSERT_EQ(319723570, execute(R"(
+        r = sys_Blob_mapFile("map-file-test.bin") ? {
+            b = _;
+            c = @b;
+            c[0] := 100;
+            b[1] := 9;
+            b[0] + b[1] + b[2] + c[0] + sys_Container_size(b) * 1000000
+        } : -1;
+        again = sys_Blob_mapFile("map-file-test.bin") ? _[1] : -1;
+        missing = sys_Blob_mapFile("no-such-file.bin") ? 1 : 0;
+        r * 100 + again * 10 + missing
+    )"));
+    std::remove("map-file-test.bin");
+}
+
+TEST(Parser, ByteBuffer) {
+    ASSERT_EQ(20258200713, execute(R"(
+        b = sys_ByteBuffer;
+        sys_ByteBuffer_resize(b, 15);
+        sys_ByteBuffer_setI16Be(b, 0, 258);
+        sys_ByteBuffer_setI32(b, 2, -5);
+        sys_ByteBuffer_setF64Be(b, 6, 2.5);
+        sys_ByteBuffer_setAt(b, 14, 200);
+        sys_ByteBuffer_setI64(b, 10, 7);
+        c = @b;
+        sys_ByteBuffer_resize(c, 20);
+        sys_ByteBuffer_copy(c, 15, b, 0, 2);
+        sys_ByteBuffer_getI16(b, 0) +
+        sys_ByteBuffer_getI32(b, 2) * 10 +
+        int(sys_ByteBuffer_getF64Be(c, 6) * 100.0) +
+        sys_ByteBuffer_getAt(c, 14) * 1000 +
+        sys_ByteBuffer_getI16Be(c, 15) * 1000000 +
+        sys_ByteBuffer_size(c) * 1000000000 +
+        sys_ByteBuffer_getI64(b, 10)
+    )"));
+}
+
+TEST(Parser, ByteBufferBuilderAndRope) {
+    ASSERT_EQ(111, execute(R"(
+        b = sys_ByteBuffer;
+        sys_ByteBuffer_appendInt(b, -123);
+        sys_ByteBuffer_appendByte(b, 44);
+        sys_ByteBuffer_appendDouble(b, 0.1);
+        t = @b;
+        sys_ByteBuffer_appendBuffer(b, t);
+        x = sys_Blob;
+        sys_Container_insert(x, 0, 20);
+        i = 0;
+        loop {
+            x[i] := 65 + i;
+            i := i + 1;
+            i == 20 ? 0
+        };
+        sys_ByteBuffer_appendBlob(b, x, 8, 1);
+        f = sys_ByteBuffer_finish(b);
+        built = sys_Container_size(f) == 3 && sys_ByteBuffer_size(b) == 0 &&
+            sys_Blob_getByteAt(f, 0) == 45 && sys_Blob_getByteAt(f, 14) == 46 &&
+            sys_Blob_getByteAt(f, 16) == 66 && sys_Blob_getByteAt(f, 17) == 0 &&
+            !sys_ByteBuffer_appendBlob(b, x, 150, 20) ? 1 : 0;
+        r = sys_Rope;
+        sys_Rope_appendBlob(r, x, 0, 160);
+        sys_Rope_appendBlob(r, f, 0, 17);
+        sys_Rope_append(r, r);
+        c = @r;
+        sys_Rope_appendBlob(c, x, 0, 8);
+        x[0] := 1;
+        s = sys_Rope_slice(r, 170, 180);
+        j = sys_Rope_finish(s);
+        roped = sys_Rope_size(r) == 354 && sys_Rope_size(c) == 362 &&
+            sys_Rope_getAt(r, 0) == 65 && sys_Rope_getAt(r, 354) == -1 &&
+            sys_Rope_getAt(s, 0) == 50 && sys_Rope_getAt(c, 354) == 65 ? 10 : 0;
+        finished = sys_Container_size(j) == 2 && sys_Blob_getByteAt(j, 7) == 65 &&
+            sys_Blob_getByteAt(j, 10) == 0 ? 100 : 0;
+        built + roped + finished
+    )"));
+}
+
+TEST(Parser, NumberText) {
+    ASSERT_EQ(111, execute(R"(
+        b = sys_ByteBuffer;
+        at = sys_ByteBuffer_putInt(b, 0, -1234567890123);
+        sys_ByteBuffer_appendByte(b, 44);
+        end = sys_ByteBuffer_putDouble(b, at + 1, 0.1);
+        buffer = sys_ByteBuffer_size(b) == 18 && end == 18 &&
+            sys_ByteBuffer_parseInt(b, 0) == -1234567890123 &&
+            sys_ByteBuffer_numberEnd(b, 0) == 14 &&
+            sys_ByteBuffer_parseDouble(b, 15) == 0.1 &&
+            sys_ByteBuffer_putInt(b, 19, 1) == -1 &&
+            sys_ByteBuffer_parseInt(b, 14) == 0 ? 1 : 0;
+        a = sys_Blob;
+        at := sys_Blob_putInt(a, 0, 42);
+        at := sys_Blob_putDouble(a, at + 1, 2.5);
+        blob = sys_Container_size(a) == 1 && at == 6 &&
+            sys_Blob_getByteAt(a, 2) == 0 &&
+            sys_Blob_parseInt(a, 0) + sys_Blob_parseInt(a, 1) == 44 &&
+            sys_Blob_parseDouble(a, 3) == 2.5 &&
+            sys_Blob_numberEnd(a, 3) == 6 ? 10 : 0;
+        i = 0;
+        loop {
+            sys_ByteBuffer_putInt(b, sys_ByteBuffer_size(b), i * 1000003);
+            sys_ByteBuffer_appendByte(b, 32);
+            i := i + 1;
+            i == 100 ? 0
+        };
+        pos = 18;
+        sum = 0;
+        loop {
+            sum := sum + sys_ByteBuffer_parseInt(b, pos);
+            pos := sys_ByteBuffer_numberEnd(b, pos) + 1;
+            pos >= sys_ByteBuffer_size(b) ? 0
+        };
+        blob + buffer + (sum == 4950 * 1000003 ? 100 : 0)
+    )"));
+}
+
+TEST(Parser, FileStreaming) {
+    ASSERT_EQ(29290852, execute(R"(
+        b = sys_Blob;
+        sys_Container_insert(b, 0, 3);
+        b[0] := 1;
+        b[1] := 2;
+        b[2] := 3;
+        w = sys_File_open("file-io-test.bin", 1) ? {
+            f = _;
+            sys_File_write(f, b, 0, 24) + sys_File_write(f, b, 8, 5) + (sys_File_flush(f) ? 0 : 1000)
+        } : -1;
+        r = sys_Blob;
+        n = sys_File_open("file-io-test.bin", 0) ? {
+            f = _;
+            a = sys_File_read(f, r, 0, 100);
+            sys_File_seek(f, 8);
+            a * 100 + sys_File_read(f, r, 29, 8)
+        } : -1;
+        missing = sys_File_open("no-such-file.bin", 0) ? 1 : 0;
+        w * 1000000 + n * 100 + sys_Container_size(r) * 10 + sys_Blob_getByteAt(r, 29) + missing
+    )"));
+    std::remove("file-io-test.bin");
+}
+
+TEST(Parser, ArraySort) {
+    ASSERT_EQ(40391, execute(R"(
+        class Node {
+            x = 0;
+        }
+        a = sys_Array;
+        sys_Container_insert(a, 0, 40);
+        i = 0;
+        loop {
+            a[i] := Node;
+            a[i]&&_~Node?_.x := i * 37 % 40;
+            i := i + 1;
+            i == 40 ? 0
+        };
+        sys_Array_sort(a, (l, r) { (l&&_~Node?_.x : 0) < (r&&_~Node?_.x : 0) });
+        k = 0;
+        ok = 0;
+        each(a) { ok := ok + ((_&&_~Node?_.x : -1) == k ? 1 : 0); k := k + 1 };
+        calls = sys_Blob;
+        sys_Array_sort(a, (l, r) {
+            sys_Container_insert(calls, 0, 1);
+            (l&&_~Node?_.x : 0) > (r&&_~Node?_.x : 0)
+        });
+        ok * 1000 + (a[0]&&_~Node?_.x : -1) * 10 + (sys_Container_size(calls) > 0 ? 1 : 0)
+    )"));
+}
+
+TEST(Parser, TypedArray) {
+    ASSERT_EQ(3120851, execute(R"(
+        class Node {
+            x = 0;
+        }
+        class Graph {
+            nodes = sys_Array(Node);
+        }
+        fn sum(sys_Array(Node) a) int {
+            s = 0;
+            each(a) { s := s + (_ ? _.x : 0) };
+            s
+        }
+        g = Graph;
+        a = g.nodes;
+        sys_Container_insert(a, 0, 3);
+        a[0] := Node;
+        a[2] := Node;
+        a[0] ? _.x := 7;
+        a[2] ? _.x := 5;
+        sys_Array_sort(a, (l, r) { (l ? _.x : 0) < (r ? _.x : 0) });
+        c = @a;
+        c[1] ? _.x := 1;
+        o = sys_Array;
+        sys_Container_insert(o, 0, 2);
+        o[0] := @a;
+        o[1] := sys_Array;
+        casts = (o[0] && _~sys_Array(Node) ? 1 : 0) + (o[1] && _~sys_Array(Node) ? 10 : 0);
+        sys_Container_size(a) * 1000000 + sum(a) * 10000 + sum(c) * 100 + (a[1] ? _.x : 0) * 10 + casts
+    )"));
+}
+
+TEST(Parser, TypedArrayRejectsOtherItems) {
+    ASSERT_TRUE(rejected(R"(
+        class Node {
+            x = 0;
+        }
+        class Other {
+            y = 0;
+        }
+        a = sys_Array(Node);
+        sys_Container_insert(a, 0, 1);
+        a[0] := Other;
+        0
+    )"));
+}
+
+TEST(Parser, TypedArrayNameDoesNotClash) {
+    set_heap_image_path("typed-array-name-test.img");
+    ASSERT_EQ(43, execute(R"(
+        class Node {
+            x = 0;
+        }
+        class sys_Array_Node {
+            y = 0;
+        }
+        class Root {
+            typed = sys_Array(Node);
+            named = sys_Array_Node;
+        }
+        r = Root;
+        t = r.typed;
+        sys_Container_insert(t, 0, 1);
+        t[0] := Node;
+        t[0] ? _.x := 4;
+        r.named.y := 3;
+        sys_HeapImage_save(r);
+        sys_HeapImage_load() && _~Root ? {
+            l = _;
+            lt = l.typed;
+            (lt[0] ? _.x : 0) * 10 + l.named.y
+        } : -1
+    )"));
+    set_heap_image_path("");
+    std::remove("typed-array-name-test.img");
+}
+
+TEST(Parser, ReserveOnSharedBlob) {
+    ASSERT_EQ(201001950514, execute(R"(
+        a = sys_Blob;
+        sys_Container_insert(a, 0, 20);
+        i = 0;
+        loop {
+            a[i] := i;
+            i := i + 1;
+            i == 20 ? 0
+        };
+        b = @a;
+        sys_Container_reserve(b, 1);
+        b[19] := 100;
+        v = sys_Blob_view(a, 5, 10);
+        sys_Container_reserve(v, 3);
+        v[0] := 50;
+        sys_Container_size(b) * 10000000000 + b[19] * 10000000 + a[19] * 100000 + v[0] * 1000 + a[5] * 100 + v[9]
+    )"));
+}
+
+TEST(Parser, MoveRanges) {
+    ASSERT_EQ(324, execute(R"(
+        class Node {
+            x = 0;
+        }
+        b = sys_Blob;
+        sys_Container_insert(b, 0, 10);
+        a = sys_Array;
+        sys_Container_insert(a, 0, 10);
+        i = 0;
+        loop {
+            b[i] := i;
+            a[i] := Node;
+            i := i + 1;
+            i == 10 ? 0
+        };
+        r = sys_Blob;
+        sys_Container_insert(r, 0, 4);
+        r[0] := 1;
+        r[1] := 3;
+        r[2] := 6;
+        r[3] := 7;
+        sys_Container_moveRanges(a, r, 9);
+        sys_Container_moveRanges(b, r, 4) ? (sys_Container_moveRanges(b, r, 2) ? -2 : b[1] * 100 + b[3] * 10 + b[5]) : -1
+    )"));
+}
+
+TEST(Parser, ArrayStoresFreshObjectsWithoutCopy) {
+    ASSERT_EQ(371, execute(R"(
+        class Node {
+            x = 0;
+        }
+        fn Node_afterCopy(Node n) {
+            sys_foreignTestFunction(1);
+        }
+        fn sys_foreignTestFunction(int x) int;
+        a = sys_Array;
+        sys_Container_insert(a, 0, 2);
+        a[0] := Node;
+        n = Node;
+        n.x := 7;
+        a[1] := @n;
+        a[5] := Node;
+        a[0]&&_~Node ? _.x := 3;
+        (a[0]&&_~Node ? _.x : 0) * 100 + (a[1]&&_~Node ? _.x : 0) * 10 + sys_foreignTestFunction(0)
+    )"));
+}
+
+TEST(Parser, Maps) {
+    ASSERT_EQ(131337, execute(R"(
+        class Node {
+            x = 0;
+        }
+        m = sys_IntMap;
+        i = 0;
+        loop {
+            m[i * 7] := i;
+            i := i + 1;
+            i == 100 ? 0
+        };
+        sys_IntMap_delete(m, 14);
+        d = @m;
+        d[7] := 1000;
+        own = sys_IntOwnMap;
+        own[5] := Node;
+        own[5] && _~Node ? _.x := 30;
+        oc = @own;
+        oc[5] && _~Node ? _.x := 99;
+        k1 = Node;
+        k2 = Node;
+        om = sys_ObjIntMap;
+        om[k1] := 3;
+        om[k2] := 4;
+        om[k1] := om[k1] + 10;
+        wm = sys_ObjWeakMap;
+        wm[k2] := &k1;
+        dead = sys_ObjIntMap;
+        i := 0;
+        loop {
+            t = Node;
+            dead[t] := i;
+            i := i + 1;
+            i == 100 ? 0
+        };
+        sys_Map_size(m) + m[21] + m[14] + m[7] + d[7] +
+            (sys_IntMap_has(d, 14) ? 100000 : 0) +
+            (own[5] && _~Node ? _.x : 0) +
+            om[k1] * 10000 + om[k2] +
+            (wm[k2] && _==k1 ? 200 : 0) +
+            (sys_Map_size(dead) < 16 ? 0 : 100000)
+    )"));
+}
+
+TEST(Parser, Deque) {
+    ASSERT_EQ(182418197, execute(R"(
+        class Node {
+            x = 0;
+        }
+        q = sys_IntDeque;
+        i = 0;
+        loop {
+            sys_IntDeque_pushBack(q, i);
+            sys_IntDeque_pushFront(q, 0 - i);
+            i := i + 1;
+            i == 10 ? 0
+        };
+        s = 0;
+        i := 0;
+        loop {
+            s := s + sys_IntDeque_popFront(q);
+            i := i + 1;
+            i == 3 ? 0
+        };
+        c = @q;
+        sys_IntDeque_pushBack(c, 100);
+        last = sys_IntDeque_popBack(q);
+        sys_IntDeque_clear(q);
+        o = sys_OwnDeque;
+        sys_OwnDeque_pushBack(o, Node);
+        sys_OwnDeque_pushFront(o, Node);
+        o[1] && _~Node ? _.x := 7;
+        oc = @o;
+        oc[1] && _~Node ? _.x := 8;
+        p = sys_OwnDeque_popBack(o);
+        (sys_Deque_size(q) == 0 && sys_IntDeque_popFront(q) == 0 && sys_Deque_size(o) == 1 ? 100000000 : 0) +
+            (oc[1] && _~Node ? _.x : 0) * 10000000 +
+            (0 - s) * 100000 +
+            sys_Deque_size(c) * 1000 +
+            c[17] +
+            last * 10 +
+            (p && _~Node ? _.x : 0)
+    )"));
+}
+
+TEST(Parser, Strings) {
+    ASSERT_EQ(48219, execute(R"(
+        a = "Hello";
+        b = sys_String_concat(a, ", world");
+        c = sys_String_concat(b, " and a long tail past inline storage");
+        s = sys_String_slice(c, 7, 12);
+        t = @"world";
+        (sys_String_compare(s, t) == 0 && sys_String_hash(s) == sys_String_hash(t) ? 100 : 0) +
+        (sys_String_compare(a, b) < 0 ? sys_String_size(c) * 1000 : 0) +
+        s[0] + sys_String_getAt("\"q\"", 0) - 34 + a[99]
+    )"));
+}
+
 TEST(Parser, IntegerOps) {
     ASSERT_EQ(7, execute("(2 ^ 2 * 3 + 1) << (2-1) | (2+2) | (3 & (2>>1))"));
 }
@@ -432,4 +1111,168 @@ TEST(Parser, Raii) {
     )"));
 }
 
+TEST(Parser, AllocatorHooks) {
+    ASSERT_EQ(4000, execute(R"(
+        class Node {
+            x = 1;
+            next = ?Node;
+        }
+        fn Node_allocate(int size) int { sys_foreignTestAllocate(size) }
+        fn Node_free(int ptr) { sys_foreignTestFree(ptr) }
+        fn sys_foreignTestAllocate(int size) int;
+        fn sys_foreignTestFree(int ptr);
+        fn sys_foreignTestFunction(int x) int;
+        live = {
+            a = Node;
+            a.next := +Node;
+            b = @a;
+            sys_foreignTestFunction(0)
+        };
+        live + sys_foreignTestFunction(0)
+    )"));
+}
+
+TEST(Parser, Channel) {
+    ASSERT_EQ(34507, execute(R"(
+        class Node {
+            x = 0;
+        }
+        fn mk(int x) Node {
+            n = Node;
+            n.x := x;
+            n
+        }
+        c = sys_Channel;
+        sys_Channel_send(c, mk(3));
+        sys_Channel_send(c, mk(4));
+        n = Node;
+        n.x := 5;
+        sys_Channel_send(c, @n);
+        n.x := 6;
+        sys_Channel_close(c);
+        s = 0;
+        loop {
+            r = sys_Channel_receive(c);
+            r && _~Node ? s := s * 10 + _.x;
+            (r ? 0 : 1) == 1 ? 0
+        };
+        t = sys_Channel_tryReceive(c) ? 1 : 0;
+        d = sys_Channel;
+        sys_Channel_send(d, mk(7));
+        sys_Channel_send(d, mk(8));
+        s * 100 + t * 10 + (sys_Channel_tryReceive(d) && _~Node ? _.x : 0)
+    )"));
+}
+
+TEST(Parser, ChannelAcrossThreads) {
+    ASSERT_EQ(107799, execute(R"(
+        class Item {
+            id = 0;
+            items = sys_Blob;
+            view = sys_Blob;
+            self = &Item;
+            outer = &Item;
+        }
+        fn sys_foreignTestEcho(sys_Channel from, sys_Channel to);
+        from = sys_Channel;
+        to = sys_Channel;
+        sys_foreignTestEcho(from, to);
+        keep = Item;
+        sys_Container_insert(keep.items, 0, 20);
+        i = 0;
+        loop {
+            it = Item;
+            it.id := i;
+            it.items := @keep.items;
+            it.self := &it;
+            it.outer := &keep;
+            (i & 1) == 0
+                ? sys_Channel_send(from, it)
+                : {
+                    it.view := sys_Blob_view(keep.items, 2, 15);
+                    sys_Channel_send(from, @it)
+                };
+            keep.items[1] := i;
+            o = &keep;
+            i := i + 1;
+            i == 100 ? 0
+        };
+        sys_Channel_close(from);
+        s = 0;
+        loop {
+            r = sys_Channel_receive(to);
+            r && _~Item ? {
+                it = _;
+                s := s + it.id + sys_Container_size(it.items) + sys_Container_size(it.view);
+                it.self && _ == it ? s := s + 1000;
+                it.outer ? s := s + 1000000
+            };
+            (r ? 0 : 1) == 1 ? 0
+        };
+        unsupported = sys_Channel;
+        s + keep.items[1] + (sys_Channel_send(unsupported, sys_Rope) ? 1000000 : 0)
+    )"));
+}
+
+TEST(Parser, HeapImage) {
+    set_heap_image_path("heap-image-test.img");
+    ASSERT_EQ(1, execute(R"(
+        class Node {
+          parent = &Node;
+          left = ?Node;
+          value = 0;
+          items = sys_Blob;
+        }
+        root = Node;
+        root.value := 40;
+        root.left := +Node;
+        root.left?_.parent := &root;
+        root.left?_.value := 2;
+        sys_Container_insert(root.items, 0, 3);
+        root.items[2] := 100;
+        sys_HeapImage_save(root) ? 1 : 0
+    )"));
+    ASSERT_EQ(186, execute(R"(
+        class Node {
+          parent = &Node;
+          left = ?Node;
+          value = 0;
+          items = sys_Blob;
+        }
+        sys_HeapImage_load() && _~Node ? {
+            root = _;
+            l = root.left ? _.value : 0;
+            p = root.left ? (_.parent ? _.value : 0) : 0;
+            c = @root;
+            c.value := 1;
+            root.value + l + p + root.items[2] + sys_Container_size(root.items) + c.value
+        } : -1
+    )"));
+    set_heap_image_path("");
+    std::remove("heap-image-test.img");
+}
+
+TEST(Parser, HeapImageRejectsChangedLayout) {
+    set_heap_image_path("heap-image-layout-test.img");
+    ASSERT_EQ(1, execute(R"(
+        class Node {
+          left = ?Node;
+          value = 0;
+        }
+        root = Node;
+        root.left := +Node;
+        root.value := 5;
+        sys_HeapImage_save(root) ? 1 : 0
+    )"));
+    ASSERT_EQ(-1, execute(R"(
+        class Node {
+          value = 0;
+          left = ?Node;
+        }
+        sys_HeapImage_load() && _~Node ? _.value : -1
+    )"));
+    set_heap_image_path("");
+    std::remove("heap-image-layout-test.img");
+}
+
 }  // namespace
@@ -3,15 +3,51 @@
 #include <string>
 #include <random>
 #include <variant>
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <new>
+#include <atomic>
+#include <thread>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "generator.h"
 #include "llvm/ExecutionEngine/Orc/LLJIT.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Analysis/BasicAliasAnalysis.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/TypeBasedAliasAnalysis.h"
+#include "llvm/Transforms/InstCombine/InstCombine.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Scalar/GVN.h"
+#include "llvm/Transforms/Utils.h"
+#include "llvm/Transforms/Vectorize.h"
 #include "llvm/Support/InitLLVM.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
 #include "vmt_util.h"
+#include "blob_util.h"
+#include "hash_map.h"
+#include "rope.h"
+#include "number_text.h"
+#include "mpsc_queue.h"
 
 using std::string;
 using std::vector;
@@ -43,7 +79,7 @@ T* dump(const char* name, T* val) {
 }
 
 #ifdef DEBUG
-int leak_detector_counter = 0;
+std::atomic<int> leak_detector_counter{ 0 };  // objects are released by channel receivers on other threads
 void leak_detector_ref(int d) { leak_detector_counter += d; }
 bool leak_detector_ok() { return leak_detector_counter == 0; }
 #else
@@ -55,6 +91,15 @@ int64_t foreign_test_function_state = 0;
 int64_t foreign_test_function(int64_t delta) {
 	return foreign_test_function_state += delta;
 }
+// Host-supplied allocator for tests, every live allocation adds 1000 to `foreign_test_function_state`.
+int64_t foreign_test_allocate(int64_t size) {
+	foreign_test_function_state += 1000;
+	return reinterpret_cast<int64_t>(new char[size]);
+}
+void foreign_test_free(int64_t ptr) {
+	foreign_test_function_state -= 1000;
+	delete[] reinterpret_cast<char*>(ptr);
+}
 
 // 
 struct OptBranch : ltm::Object {
@@ -108,7 +153,9 @@ struct Val {
 //	   - if Var is immutable, keep longterm using it as temp.
 //     - otherwise Retain.
 
-struct Object* copy_head = nullptr;
+// Copy and heap walk state is per thread, as threads receiving from sys_Channel copy and walk objects too.
+thread_local struct Object* copy_head = nullptr;
+struct Blob;
 
 struct Object {
 	struct Vmt {
@@ -116,6 +163,9 @@ struct Object {
 		void (*dispose)(void* ptr);
 		size_t instance_alloc_size;
 		size_t vmt_size;
+		void (*visit_ref_fields)(void* ptr);
+		int64_t (*allocate)(int64_t size);  // `Class_allocate` or `allocate_raw`
+		void (*free)(int64_t ptr);          // `Class_free` or `free_raw`
 	};
 	void** (*dispatcher)(uint64_t interface_and_method_ordinal);
 	uintptr_t counter;  // pointer_to_weak_block || (number_of_owns_and_refs * CTR_STEP | CRT_WEAKLESS)
@@ -134,8 +184,9 @@ struct Object {
 			obj->counter = 0;
 			release_weak(wb);
 		}
-		reinterpret_cast<const Vmt*>(obj->dispatcher)[-1].dispose(obj);
-		delete[] reinterpret_cast<char*>(obj);
+		auto& vmt = reinterpret_cast<const Vmt*>(obj->dispatcher)[-1];
+		vmt.dispose(obj);
+		vmt.free(reinterpret_cast<int64_t>(obj));
 		leak_detector_ref(-1);
 	}
 	static Object* retain(Object* obj) {
@@ -149,12 +200,20 @@ struct Object {
 		return obj;
 	}
 	static void* allocate(size_t size) {
-		auto r = new char[size];
+		return init_instance(new char[size], size);
+	}
+	static void* init_instance(void* r, size_t size) {
 		leak_detector_ref(1);
 		memset(r, 0, size);
 		reinterpret_cast<Object*>(r)->counter = CTR_STEP | CTR_WEAKLESS;
 		return r;
 	}
+	static int64_t allocate_raw(int64_t size) {
+		return reinterpret_cast<int64_t>(new char[size]);
+	}
+	static void free_raw(int64_t ptr) {
+		delete[] reinterpret_cast<char*>(ptr);
+	}
 	static uintptr_t get_ptr_tag(void* ptr) noexcept {
 		return reinterpret_cast<uintptr_t>(ptr) & 3;
 	}
@@ -202,7 +261,7 @@ struct Object {
 		if (!src || size_t(src) < 256)
 			return src;
 		const auto& vmt = reinterpret_cast<const Vmt*>(src->dispatcher)[-1];
-		auto d = reinterpret_cast<Object*>(new char[vmt.instance_alloc_size]);
+		auto d = reinterpret_cast<Object*>(vmt.allocate(vmt.instance_alloc_size));
 		leak_detector_ref(1);
 		memcpy(d, src, vmt.instance_alloc_size);
 		reinterpret_cast<Object*>(d)->counter = CTR_STEP | CTR_WEAKLESS;
@@ -241,6 +300,7 @@ struct Object {
 		CTR_WEAKLESS = 1,
 		CTR_FROZEN = 2,
 		CTR_STEP = 0x10,
+		CTR_IMMORTAL = (uintptr_t(1) << (sizeof(uintptr_t) * 8 - 2)) | CTR_WEAKLESS,  // never reaches zero
 	};
 	enum Tag : uintptr_t {
 		TG_WEAK_BLOCK = 0,
@@ -331,38 +391,227 @@ struct Object {
 	static void reg_copy_fixer(Object* object, void (*fixer)(Object*)) {
 		copy_fixers.push_back({ object, fixer });
 	}
-	static vector<pair<Object*, void (*)(Object*)>> copy_fixers;  // Used only for objects with manual afterCopy operators.
+	static thread_local vector<pair<Object*, void (*)(Object*)>> copy_fixers;  // Used only for objects with manual afterCopy operators.
+
+	// Receives pointer fields of objects walked by `Vmt::visit_ref_fields`.
+	struct FieldVisitor {
+		enum Items { RAW, OWNS, WEAKS };
+		virtual void on_object_field(Object** field) = 0;
+		virtual void on_weak_field(Weak** field) = 0;
+		virtual void on_buffer(int64_t** field, uint64_t* capacity, size_t size, Items items) = 0;  // container data, capacity can be null
+		virtual void on_unsupported() = 0;  // object that can't be walked, like hash maps
+		virtual void on_blob(Blob* container) {}  // precedes `on_buffer` of Blob containers, whose buffers can be shared
+	};
+	static thread_local FieldVisitor* field_visitor;  // Set for the duration of a heap walk.
+	static void visit_object_field(Object** field) {
+		field_visitor->on_object_field(field);
+	}
+	static void visit_weak_field(Weak** field) {
+		field_visitor->on_weak_field(field);
+	}
 };
 
-vector<pair<Object*, void (*)(Object*)>> Object::copy_fixers;
+thread_local vector<pair<Object*, void (*)(Object*)>> Object::copy_fixers;
+thread_local Object::FieldVisitor* Object::field_visitor = nullptr;
 
+// Maps a non-empty file copy-on-write: writes are private and never reach the file.
+// The view is preceded by `prefix` zeroed writable bytes, `prefix` must be a multiple of `map_granularity`.
+// Returns null on failure.
+static char* map_file(const char* file_name, uint64_t& size, uint64_t prefix = 0) {
+	char* r = nullptr;
+#ifdef _WIN32
+	auto file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return nullptr;
+	LARGE_INTEGER file_size;
+	HANDLE mapping = GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0
+		? CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr)
+		: nullptr;
+	CloseHandle(file);
+	if (!mapping)
+		return nullptr;
+	size = file_size.QuadPart;
+	if (!prefix) {
+		r = static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+	} else if (auto region = static_cast<char*>(VirtualAlloc(nullptr, prefix + size, MEM_RESERVE, PAGE_NOACCESS))) {
+		VirtualFree(region, 0, MEM_RELEASE);  // the address range is taken over by the prefix and the view
+		if (VirtualAlloc(region, prefix, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE)) {
+			r = static_cast<char*>(MapViewOfFileEx(mapping, FILE_MAP_COPY, 0, 0, 0, region + prefix));
+			if (!r)
+				VirtualFree(region, 0, MEM_RELEASE);
+		}
+	}
+	CloseHandle(mapping);
+#else
+	int file = open(file_name, O_RDONLY);
+	if (file < 0)
+		return nullptr;
+	struct stat st;
+	if (fstat(file, &st) == 0 && st.st_size > 0) {
+		size = st.st_size;
+		void* region = mmap(nullptr, prefix + size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (region != MAP_FAILED) {
+			r = static_cast<char*>(region) + prefix;
+			if (mmap(r, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, file, 0) == MAP_FAILED) {
+				munmap(region, prefix + size);
+				r = nullptr;
+			}
+		}
+	}
+	close(file);
+#endif
+	return r;
+}
+static void unmap_file(char* data, uint64_t size, uint64_t prefix = 0) {
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	if (prefix)
+		VirtualFree(data - prefix, 0, MEM_RELEASE);
+#else
+	munmap(data - prefix, prefix + size);
+#endif
+}
+static uint64_t map_granularity() {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwAllocationGranularity;
+#else
+	return sysconf(_SC_PAGESIZE);
+#endif
+}
+
+struct String;
+
+// Heap item buffers are preceded by a reference counter.
+// Blob copies share the buffer of the original, and both sides set their capacity to 0.
+// So a blob having capacity below size doesn't own its items and calls `unshare` before writing them.
+// Views made by `sys_Blob_view` share buffers the same way, but their `data` points inside the buffer,
+// so shared blobs keep the buffer start in `inline_items[0]`, which is unused while items are on heap.
+// Arrays copy their items and never share.
+// Buffers of `sys_Blob_mapFile` are private file mappings, their counter lives in a header page in front.
 struct Blob : Object {
 	uint64_t size;
 	int64_t* data;
+	uint64_t capacity;  // `data` items allocated, >= size, or 0 if items are shared
+	int64_t inline_items[8];  // `data` points here while container is small
+
+	static constexpr uint64_t INLINE_CAPACITY = sizeof(inline_items) / sizeof(int64_t);
+	static constexpr uint64_t MAPPED_BUFFER = uint64_t(1) << 63;  // buffer counter flag, data[-2] holds the file size
+	static void** (*cls_dispatcher)(uint64_t);  // sys_Blob dispatcher of the running module, set in `execute`
+
+	static int64_t* new_buffer(uint64_t capacity) {
+		auto r = new int64_t[capacity + 1];
+		r[0] = 1;
+		return r + 1;
+	}
+	static uint64_t& buffer_counter(int64_t* data) {
+		return reinterpret_cast<uint64_t*>(data)[-1];
+	}
+	static Blob* make();  // new empty sys_Blob
+	static Blob* map_file(String* file_name);  // retained blob or null
+	// Items [from, from + count) clamped to `b`, in O(1). Views share the buffer of `b` like copies do,
+	// while short ones copy their few items, so they don't keep a large buffer alive.
+	static Blob* view(Blob* b, uint64_t from, uint64_t count) {
+		from = std::min(from, b->size);
+		count = std::min(count, b->size - from);
+		auto r = make();
+		r->size = count;
+		if (count <= INLINE_CAPACITY || b->data == b->inline_items) {
+			if (count) {
+				r->data = r->inline_items;
+				r->capacity = INLINE_CAPACITY;
+				memcpy(r->inline_items, b->data + from, sizeof(int64_t) * count);
+			}
+		} else {
+			r->inline_items[0] = reinterpret_cast<int64_t>(share(b));
+			r->data = b->data + from;
+			r->capacity = 0;
+		}
+		return r;
+	}
 
 	static int64_t get_size(Blob* b) {
 		return b->size;
 	}
+	static int64_t* buffer_start(Blob* b) {  // heap buffer holding `data`, or inline items
+		return b->capacity < b->size ? reinterpret_cast<int64_t*>(b->inline_items[0]) : b->data;
+	}
+	static void release_buffer(int64_t* start) {
+		if ((--buffer_counter(start) & ~MAPPED_BUFFER) != 0)
+			return;
+		if (buffer_counter(start) & MAPPED_BUFFER)
+			unmap_file(reinterpret_cast<char*>(start), start[-2], map_granularity());
+		else
+			delete[] (start - 1);
+	}
+	static void free_data(Blob* b) {
+		if (b->data && b->data != b->inline_items)
+			release_buffer(buffer_start(b));
+	}
+	static int64_t* share(Blob* b) {  // heap items of `b` become shared, returns the buffer start with one more holder
+		auto start = buffer_start(b);
+		++buffer_counter(start);
+		b->inline_items[0] = reinterpret_cast<int64_t>(start);
+		b->capacity = 0;
+		return start;
+	}
+	static void reallocate(Blob* b, uint64_t capacity) {  // keeps `size` items
+		auto new_data = capacity == 0 ? nullptr
+			: capacity <= INLINE_CAPACITY ? b->inline_items
+			: new_buffer(capacity);
+		if (new_data != b->data) {
+			auto old_start = b->data && b->data != b->inline_items ? buffer_start(b) : nullptr;  // before inline items get overwritten
+			if (b->size)
+				memcpy(new_data, b->data, sizeof(int64_t) * b->size);
+			if (old_start)
+				release_buffer(old_start);
+			b->data = new_data;
+		}
+		b->capacity = new_data == b->inline_items ? INLINE_CAPACITY : capacity;
+	}
+	static void allocate_copy(Blob* d, Blob* s) {  // exact-fit storage for `s` items, items are not copied
+		d->size = s->size;
+		d->data = s->size == 0 ? nullptr
+			: s->size <= INLINE_CAPACITY ? d->inline_items
+			: new_buffer(s->size);
+		d->capacity = d->data == d->inline_items ? INLINE_CAPACITY : s->size;
+	}
+	static int64_t* unshare(Blob* b) {  // makes items writable, returns `data`
+		if (b->capacity < b->size) {
+			auto start = buffer_start(b);
+			if (start == b->data && (buffer_counter(start) & ~MAPPED_BUFFER) == 1)  // other holders are gone, the buffer has at least `size` items
+				b->capacity = b->size;
+			else
+				reallocate(b, b->size);
+		}
+		return b->data;
+	}
+	static void reserve(Blob* b, uint64_t capacity) {  // shared items have capacity below size, so they get unshared first
+		if (capacity > b->capacity)
+			reallocate(b, std::max(capacity, b->size));
+	}
+	static void shrink(Blob* b) {
+		if (b->capacity > b->size)
+			reallocate(b, b->size);
+	}
 	static void insert_items(Blob* b, uint64_t index, uint64_t count) {
 		if (!count || index > b->size)
 			return;
-		auto new_data = new int64_t[b->size + count];
-		memcpy(new_data, b->data, sizeof(int64_t) * index);
-		memset(new_data + index, 0, sizeof(int64_t) * count);
-		memcpy(new_data + index + count, b->data + index, sizeof(int64_t) * (b->size - index));
-		delete[] b->data;
-		b->data = new_data;
+		if (b->size + count > b->capacity)
+			reallocate(b, std::max(b->size + count, b->capacity * 2));
+		memmove(b->data + index + count, b->data + index, sizeof(int64_t) * (b->size - index));
+		memset(b->data + index, 0, sizeof(int64_t) * count);
 		b->size += count;
 	}
 	static void delete_blob_items(Blob* b, uint64_t index, uint64_t count) {
 		if (!count || index > b->size || index + count > b->size)
 			return;
-		auto new_data = new int64_t[b->size - count];
-		memcpy(new_data, b->data, sizeof(int64_t) * index);
-		memcpy(new_data + index, b->data + index + count, sizeof(int64_t) * (b->size - index));
-		delete[] b->data;
-		b->data = new_data;
+		unshare(b);
+		memmove(b->data + index, b->data + index + count, sizeof(int64_t) * (b->size - index - count));
 		b->size -= count;
+		if (b->size < b->capacity / 4)  // shrink lazily, leaving room to grow back
+			reallocate(b, b->size * 2);
 	}
 	static void delete_array_items(Blob* b, uint64_t index, uint64_t count) {
 		if (!count || index > b->size || index + count > b->size)
@@ -387,20 +636,46 @@ struct Blob : Object {
 	static bool move_array_items(Blob* blob, uint64_t a, uint64_t b, uint64_t c) {
 		if (a >= b || b >= c || c > blob->size)
 			return false;
-		auto temp = new uint64_t[b - a];
-		memmove(temp, blob->data + a, sizeof(uint64_t) * (b - a));
-		memmove(blob->data + a, blob->data + b, sizeof(uint64_t) * (c - b));
-		memmove(blob->data + a + (c - b), temp, sizeof(uint64_t) * (b - a));
-		delete[] temp;
+		unshare(blob);
+		blob_util::rotate(blob->data + a, blob->data + b, blob->data + c);
 		return true;
 	}
+	// Sorting with a comparator that can change containers works on items taken out of the array,
+	// so the comparator sees an empty array and can't free or move the items being sorted.
+	static int64_t* take_items(Blob* b) {  // heap buffer of `size` items, leaves `b` empty
+		auto data = b->data;
+		if (data == b->inline_items) {
+			data = new_buffer(b->size);
+			memcpy(data, b->inline_items, sizeof(int64_t) * b->size);
+		}
+		b->size = b->capacity = 0;
+		b->data = nullptr;
+		return data;
+	}
+	static void return_items(Blob* b, int64_t* data, uint64_t size) {  // items added meanwhile go after the returned ones
+		if (!data)
+			return;
+		if (b->size == 0) {
+			free_data(b);
+			b->data = data;
+			b->size = b->capacity = size;
+			return;
+		}
+		insert_items(b, 0, size);
+		memcpy(b->data, data, sizeof(int64_t) * size);
+		delete[] (data - 1);
+	}
+	static bool move_ranges(Blob* blob, Blob* ranges, uint64_t to) {  // `ranges` holds [begin, end) pairs
+		return ranges->size % 2 == 0 &&
+			blob_util::move_ranges(unshare(blob), blob->size, ranges->data, ranges->size / 2, to);
+	}
 
 	static int64_t get_at(Blob* b, uint64_t index) {
 		return index < b->size ? b->data[index] : 0;
 	}
 	static void set_at(Blob* b, uint64_t index, int64_t val) {
 		if (index < b->size)
-			b->data[index] = val;
+			unshare(b)[index] = val;
 	}
 	static int64_t get_i8_at(Blob* b, uint64_t index) {
 		return index / sizeof(int64_t) < b->size
@@ -409,97 +684,1638 @@ struct Blob : Object {
 	}
 	static void set_i8_at(Blob* b, uint64_t index, int64_t val) {
 		if (index / sizeof(int64_t) < b->size)
-			reinterpret_cast<uint8_t*>(b->data)[index] = static_cast<uint8_t>(val);
+			reinterpret_cast<uint8_t*>(unshare(b))[index] = static_cast<uint8_t>(val);
 	}
 	static bool blob_copy(Blob* dst, uint64_t dst_index, Blob* src, uint64_t src_index, uint64_t bytes) {
-		if ((src_index + bytes) / sizeof(int64_t) >= src->size || (dst_index + bytes) / sizeof(int64_t) >= dst->size)
+		auto src_bytes = src->size * sizeof(int64_t);
+		auto dst_bytes = dst->size * sizeof(int64_t);
+		if (src_index > src_bytes || bytes > src_bytes - src_index || dst_index > dst_bytes || bytes > dst_bytes - dst_index)
 			return false;
+		if (bytes)
+			unshare(dst);
 		memmove(reinterpret_cast<uint8_t*>(dst->data) + dst_index, reinterpret_cast<uint8_t*>(src->data) + src_index, bytes);
 		return true;
 	}
-
-	static Object* get_ref_at(Blob* b, uint64_t index) {
-		return index < b->size
-			? Object::retain(reinterpret_cast<Object*>(b->data[index]))
-			: nullptr;
+
+	// Bulk operations, see blob_util.
+	static void fill(Blob* b, uint64_t index, uint64_t count, int64_t val) {
+		if (index < b->size)
+			blob_util::fill(unshare(b) + index, std::min(count, b->size - index), val);
+	}
+	static int64_t sum(Blob* b) {
+		return blob_util::sum(b->data, b->size);
+	}
+	static int64_t min(Blob* b) {
+		return b->size ? blob_util::min(b->data, b->size) : 0;
+	}
+	static int64_t max(Blob* b) {
+		return b->size ? blob_util::max(b->data, b->size) : 0;
+	}
+	static int64_t compare(Blob* a, Blob* b) {  // lexicographic, -1, 0 or 1
+		auto common = std::min(a->size, b->size);
+		auto at = blob_util::mismatch(a->data, b->data, common);
+		if (at < common)
+			return a->data[at] < b->data[at] ? -1 : 1;
+		return a->size < b->size ? -1 : a->size > b->size ? 1 : 0;
+	}
+	static int64_t find_byte(Blob* b, uint64_t from, int64_t val) {  // byte index or -1
+		auto bytes = b->size * sizeof(int64_t);
+		if (from >= bytes)
+			return -1;
+		auto at = from + blob_util::find_byte(reinterpret_cast<uint8_t*>(b->data) + from, bytes - from, static_cast<uint8_t>(val));
+		return at < bytes ? at : -1;
+	}
+	static int64_t find_int(Blob* b, uint64_t from, int64_t val) {  // item index or -1
+		if (from >= b->size)
+			return -1;
+		auto at = from + blob_util::find(b->data + from, b->size - from, val);
+		return at < b->size ? at : -1;
+	}
+	static int64_t count(Blob* b, int64_t val) {
+		return blob_util::count(b->data, b->size, val);
+	}
+	static void add(Blob* dst, Blob* src) {  // over the common prefix
+		blob_util::add(unshare(dst), src->data, std::min(dst->size, src->size));
+	}
+	static void mul(Blob* dst, Blob* src) {
+		blob_util::mul(unshare(dst), src->data, std::min(dst->size, src->size));
+	}
+	static void sort(Blob* b) {
+		if (b->size > 1)
+			blob_util::radix_sort(unshare(b), b->size);
+	}
+	static bool sort_indices(Blob* keys, Blob* indices) {  // `indices` must have the size of `keys`
+		if (keys == indices || keys->size != indices->size)
+			return false;
+		if (keys->size)
+			blob_util::sort_indices(keys->data, keys->size, unshare(indices));
+		return true;
+	}
+	static int64_t lower_bound(Blob* b, int64_t val) {  // in a sorted blob
+		return blob_util::lower_bound(b->data, b->size, val);
+	}
+	static int64_t upper_bound(Blob* b, int64_t val) {
+		return blob_util::upper_bound(b->data, b->size, val);
+	}
+	// Stable hashes, equal to blob_util::hash and hash_int in the host. Byte ranges are clamped to the blob.
+	static int64_t hash(Blob* b, uint64_t from_byte, uint64_t bytes, int64_t seed) {
+		auto size = b->size * sizeof(int64_t);
+		from_byte = std::min(from_byte, size);
+		return blob_util::hash(reinterpret_cast<char*>(b->data) + from_byte, std::min(bytes, size - from_byte), seed);
+	}
+	static int64_t hash_int(int64_t val, int64_t seed) {
+		return blob_util::hash_int(val, seed);
+	}
+	// Number text at byte offsets, as in ByteBuffer, writes append zero items as needed.
+	static int64_t put_text(Blob* b, uint64_t at, const char* text, size_t size) {
+		if (at > b->size * sizeof(int64_t))
+			return -1;
+		auto items = (at + size + sizeof(int64_t) - 1) / sizeof(int64_t);
+		if (items > b->size)
+			insert_items(b, b->size, items - b->size);
+		memcpy(reinterpret_cast<char*>(unshare(b)) + at, text, size);
+		return at + size;
+	}
+	static int64_t put_int(Blob* b, uint64_t at, int64_t val) {
+		char text[number_text::MAX_INT_CHARS];
+		return put_text(b, at, text, number_text::format_int(val, text));
+	}
+	static int64_t put_double(Blob* b, uint64_t at, double val) {
+		char text[number_text::MAX_DOUBLE_CHARS];
+		return put_text(b, at, text, number_text::format_double(val, text));
+	}
+	static int64_t parse_int(Blob* b, uint64_t at) {
+		int64_t r = 0;
+		if (at < b->size * sizeof(int64_t))
+			number_text::parse_int(reinterpret_cast<char*>(b->data) + at, b->size * sizeof(int64_t) - at, r);
+		return r;
+	}
+	static double parse_double(Blob* b, uint64_t at) {
+		double r = 0;
+		if (at < b->size * sizeof(int64_t))
+			number_text::parse_double(reinterpret_cast<char*>(b->data) + at, b->size * sizeof(int64_t) - at, r);
+		return r;
+	}
+	static int64_t number_end(Blob* b, uint64_t at) {
+		double unused;
+		auto bytes = b->size * sizeof(int64_t);
+		return at < bytes ? at + number_text::parse_double(reinterpret_cast<char*>(b->data) + at, bytes - at, unused) : at;
+	}
+
+	// sys_Bitset keeps bits in items, bit `i` is bit `i % 64` of item `i / 64`.
+	// Bits past the end read as zeros, `set_bit` and the growing bulk ops append zero items as needed.
+	static void set_bit(Blob* b, uint64_t index) {
+		auto word = index / 64;
+		if (word >= b->size)
+			insert_items(b, b->size, word + 1 - b->size);
+		unshare(b)[word] |= int64_t(1) << (index % 64);
+	}
+	static void clear_bit(Blob* b, uint64_t index) {
+		if (index / 64 < b->size)
+			unshare(b)[index / 64] &= ~(int64_t(1) << (index % 64));
+	}
+	static bool test_bit(Blob* b, uint64_t index) {
+		return index / 64 < b->size && (uint64_t(b->data[index / 64]) >> (index % 64) & 1);
+	}
+	static void bits_and(Blob* dst, Blob* src) {
+		if (!dst->size)
+			return;
+		auto common = std::min(dst->size, src->size);
+		auto data = unshare(dst);
+		blob_util::bit_and(data, src->data, common);
+		blob_util::fill(data + common, dst->size - common, 0);
+	}
+	static void bits_or(Blob* dst, Blob* src) {
+		if (dst->size < src->size)
+			insert_items(dst, dst->size, src->size - dst->size);
+		if (src->size)
+			blob_util::bit_or(unshare(dst), src->data, src->size);
+	}
+	static void bits_xor(Blob* dst, Blob* src) {
+		if (dst->size < src->size)
+			insert_items(dst, dst->size, src->size - dst->size);
+		if (src->size)
+			blob_util::bit_xor(unshare(dst), src->data, src->size);
+	}
+	static void bits_andnot(Blob* dst, Blob* src) {
+		if (auto common = std::min(dst->size, src->size))
+			blob_util::bit_andnot(unshare(dst), src->data, common);
+	}
+	static int64_t popcount(Blob* b) {
+		return blob_util::popcount(b->data, b->size);
+	}
+	static int64_t find_set_bit(Blob* b, uint64_t from) {  // bit index or -1
+		auto at = blob_util::find_set_bit(b->data, b->size, from);
+		return at < b->size * 64 ? int64_t(at) : -1;
+	}
+
+	static Object* get_ref_at(Blob* b, uint64_t index) {
+		return index < b->size
+			? Object::retain(reinterpret_cast<Object*>(b->data[index]))
+			: nullptr;
+	}
+	static Object::Weak* get_weak_at(Blob* b, uint64_t index) {
+		return index < b->size
+			? Object::retain_weak(reinterpret_cast<Object::Weak*>(b->data[index]))
+			: nullptr;
+	}
+	static void set_ref_at(Blob* b, uint64_t index, Object* val) {
+		if (index < b->size) {
+			auto dst = reinterpret_cast<Object**>(b->data) + index;
+			val = Object::copy(val);
+			Object::release(*dst);
+			*dst = val;
+		}
+	}
+	static void set_weak_at(Blob* b, uint64_t index, Object::Weak* val) {
+		if (index < b->size) {
+			auto dst = reinterpret_cast<Object::Weak**>(b->data) + index;
+			val = Object::retain_weak(val);
+			Object::release_weak(*dst);
+			*dst = val;
+		}
+	}
+	static void copy_container_fields(void* dst, void* src) {
+		auto d = reinterpret_cast<Blob*>(dst);
+		auto s = reinterpret_cast<Blob*>(src);
+		if (s->size > INLINE_CAPACITY) {  // heap items, shared till the first write
+			d->inline_items[0] = reinterpret_cast<int64_t>(share(s));
+			d->size = s->size;
+			d->data = s->data;
+			d->capacity = 0;
+			return;
+		}
+		allocate_copy(d, s);
+		memcpy(d->data, s->data, sizeof(int64_t) * d->size);
+	}
+	static void copy_array_fields(void* dst, void* src) {
+		auto d = reinterpret_cast<Blob*>(dst);
+		auto s = reinterpret_cast<Blob*>(src);
+		allocate_copy(d, s);
+		for (
+			auto
+				from = reinterpret_cast<Object**>(s->data),
+				to = reinterpret_cast<Object**>(d->data),
+				term = from + d->size;
+			from < term;
+			from++, to++)
+		{
+			*to = Object::copy_object_field(*from);
+		}
+	}
+	static void copy_weak_array_fields(void* dst, void* src) {
+		auto d = reinterpret_cast<Blob*>(dst);
+		auto s = reinterpret_cast<Blob*>(src);
+		allocate_copy(d, s);
+		auto to = reinterpret_cast<void**>(d->data);
+		for (
+			auto
+				from = reinterpret_cast<Object::Weak**>(s->data),
+				term = from + d->size;
+			from < term;
+			from++, to++) {
+			Object::copy_weak_field(to, *from);
+		}
+	}
+	static void dispose_container(void* ptr) {
+		free_data(reinterpret_cast<Blob*>(ptr));
+	}
+	static void dispose_array(void* ptr) {
+		auto p = reinterpret_cast<Blob*>(ptr);
+		for (auto ptr = reinterpret_cast<Object**>(p->data), to = ptr + p->size; ptr < to; ptr++)
+			Object::release(*ptr);
+		free_data(p);
+	}
+	static void dispose_weak_array(void* ptr) {
+		auto p = reinterpret_cast<Blob*>(ptr);
+		for (auto ptr = reinterpret_cast<Object::Weak**>(p->data), to = ptr + p->size; ptr < to; ptr++)
+			Object::release_weak(*ptr);
+		free_data(p);
+	}
+	static void visit_container_fields(void* ptr) {
+		auto p = reinterpret_cast<Blob*>(ptr);
+		Object::field_visitor->on_blob(p);
+		Object::field_visitor->on_buffer(&p->data, &p->capacity, sizeof(int64_t) * p->size, Object::FieldVisitor::RAW);
+	}
+	static void visit_array_fields(void* ptr) {
+		auto p = reinterpret_cast<Blob*>(ptr);
+		Object::field_visitor->on_blob(p);
+		Object::field_visitor->on_buffer(&p->data, &p->capacity, sizeof(int64_t) * p->size, Object::FieldVisitor::OWNS);
+	}
+	static void visit_weak_array_fields(void* ptr) {
+		auto p = reinterpret_cast<Blob*>(ptr);
+		Object::field_visitor->on_blob(p);
+		Object::field_visitor->on_buffer(&p->data, &p->capacity, sizeof(int64_t) * p->size, Object::FieldVisitor::WEAKS);
+	}
+};
+
+// Runtime part of sys_Map family, the hash table lives inline in map objects.
+// Int keys are used as is. Object keys are identified by their weak blocks, so map entries
+// don't keep keys alive, and a weak block stays unique for as long as the map holds it.
+// Entries of dead object keys are dropped when the table is about to grow.
+struct Map : Object {
+	hash_map::Table table;
+
+	enum Values { INTS, OWNS, WEAKS };
+
+	template<Values V>
+	static void release_value(int64_t value) {
+		if (V == OWNS)
+			Object::release(reinterpret_cast<Object*>(value));
+		else if (V == WEAKS)
+			Object::release_weak(reinterpret_cast<Object::Weak*>(value));
+	}
+	template<typename K, Values V>
+	static void release_entry(int64_t key, int64_t value) {
+		if (std::is_same<K, Object*>::value)
+			Object::release_weak(reinterpret_cast<Object::Weak*>(key));
+		release_value<V>(value);
+	}
+	static int64_t* find(Map* m, int64_t key) {
+		return hash_map::find(m->table, key);
+	}
+	static int64_t* find(Map* m, Object* key) {
+		if (key->counter & CTR_WEAKLESS)  // has no weak block, so it has never been a key
+			return nullptr;
+		return hash_map::find(m->table, int64_t(key->counter));
+	}
+	template<Values V>
+	static int64_t* insert(Map* m, int64_t key) {
+		bool inserted;
+		return hash_map::insert(m->table, key, inserted);
+	}
+	template<Values V>
+	static int64_t* insert(Map* m, Object* key) {
+		if (m->table.growth_left == 0) {
+			vector<pair<int64_t, int64_t>> dead;  // released after the sweep, as disposers can reenter this map
+			hash_map::for_each(m->table, [&](size_t index, int64_t& key, int64_t& value) {
+				if (!reinterpret_cast<Object::Weak*>(key)->target) {
+					dead.push_back({ key, value });
+					hash_map::erase_at(m->table, index);
+				}
+			});
+			for (auto& e : dead)
+				release_entry<Object*, V>(e.first, e.second);
+		}
+		auto wb = Object::mk_weak(key);
+		bool inserted;
+		auto r = hash_map::insert(m->table, int64_t(wb), inserted);
+		if (!inserted)
+			Object::release_weak(wb);
+		return r;
+	}
+
+	static int64_t get_size(Map* m) {
+		return m->table.size;
+	}
+	template<typename K>
+	static int64_t get_int_at(Map* m, K key) {
+		auto v = find(m, key);
+		return v ? *v : 0;
+	}
+	template<typename K>
+	static Object* get_own_at(Map* m, K key) {
+		auto v = find(m, key);
+		return v ? Object::retain(reinterpret_cast<Object*>(*v)) : nullptr;
+	}
+	template<typename K>
+	static Object::Weak* get_weak_at(Map* m, K key) {
+		auto v = find(m, key);
+		return v ? Object::retain_weak(reinterpret_cast<Object::Weak*>(*v)) : nullptr;
+	}
+	template<typename K>
+	static void set_int_at(Map* m, K key, int64_t val) {
+		*insert<INTS>(m, key) = val;
+	}
+	template<typename K>
+	static void set_own_at(Map* m, K key, Object* val) {
+		val = Object::copy(val);
+		auto v = insert<OWNS>(m, key);
+		auto old = *v;
+		*v = reinterpret_cast<int64_t>(val);
+		release_value<OWNS>(old);
+	}
+	template<typename K>
+	static void set_weak_at(Map* m, K key, Object::Weak* val) {
+		val = Object::retain_weak(val);
+		auto v = insert<WEAKS>(m, key);
+		auto old = *v;
+		*v = reinterpret_cast<int64_t>(val);
+		release_value<WEAKS>(old);
+	}
+	template<typename K>
+	static bool has(Map* m, K key) {
+		return find(m, key) != nullptr;
+	}
+	template<typename K, Values V>
+	static bool erase(Map* m, K key) {
+		auto v = find(m, key);
+		if (!v)
+			return false;
+		auto index = v - m->table.values();
+		auto old_key = m->table.keys()[index];
+		auto old_value = *v;
+		hash_map::erase_at(m->table, index);
+		release_entry<K, V>(old_key, old_value);
+		return true;
+	}
+	template<typename K, Values V>
+	static void clear(Map* m) {
+		auto table = m->table;  // detached first, as disposers can reenter this map
+		m->table = hash_map::Table{ 0, 0, 0, nullptr };
+		hash_map::for_each(table, [](size_t, int64_t key, int64_t value) { release_entry<K, V>(key, value); });
+		hash_map::reset(table);
+	}
+	template<typename K, Values V>
+	static void copy_fields(void* dst, void* src) {
+		auto d = reinterpret_cast<Map*>(dst);
+		hash_map::copy(d->table, reinterpret_cast<Map*>(src)->table);
+		hash_map::for_each(d->table, [](size_t, int64_t& key, int64_t& value) {
+			if (std::is_same<K, Object*>::value)  // copies share key identities with the original
+				Object::retain_weak(reinterpret_cast<Object::Weak*>(key));
+			if (V == OWNS)
+				value = reinterpret_cast<int64_t>(Object::copy_object_field(reinterpret_cast<Object*>(value)));
+			else if (V == WEAKS)
+				Object::copy_weak_field(reinterpret_cast<void**>(&value), reinterpret_cast<Object::Weak*>(value));
+		});
+	}
+	template<typename K, Values V>
+	static void dispose(void* ptr) {
+		clear<K, V>(reinterpret_cast<Map*>(ptr));
+	}
+	static void visit_fields(void*) {
+		Object::field_visitor->on_unsupported();
+	}
+};
+
+// Runtime part of sys_String: immutable UTF-8 bytes.
+// Up to INLINE_CAPACITY bytes are kept in the object itself, longer strings use a heap buffer of whole words.
+// Literals are immortal instances emitted by the generator, their `data` points to constant module data.
+struct String : Object {
+	uint64_t size;  // in bytes
+	char* data;
+	char inline_bytes[24];
+
+	static constexpr uint64_t INLINE_CAPACITY = sizeof(inline_bytes);
+	static void** (*cls_dispatcher)(uint64_t);  // sys_String dispatcher of the running module, set in `execute`
+
+	static void allocate_bytes(String* s, uint64_t size) {
+		s->size = size;
+		s->data = size <= INLINE_CAPACITY
+			? s->inline_bytes
+			: reinterpret_cast<char*>(new int64_t[(size + sizeof(int64_t) - 1) / sizeof(int64_t)]);
+	}
+	static String* make(uint64_t size) {  // retained instance with uninitialized bytes
+		auto& vmt = reinterpret_cast<const Object::Vmt*>(cls_dispatcher)[-1];
+		auto r = reinterpret_cast<String*>(Object::init_instance(
+			reinterpret_cast<void*>(vmt.allocate(vmt.instance_alloc_size)),
+			vmt.instance_alloc_size));
+		r->dispatcher = cls_dispatcher;
+		allocate_bytes(r, size);
+		return r;
+	}
+
+	static int64_t get_size(String* s) {
+		return s->size;
+	}
+	static int64_t get_at(String* s, uint64_t index) {
+		return index < s->size ? uint8_t(s->data[index]) : 0;
+	}
+	static String* concat(String* a, String* b) {
+		auto r = make(a->size + b->size);
+		memcpy(r->data, a->data, a->size);
+		memcpy(r->data + a->size, b->data, b->size);
+		return r;
+	}
+	static String* slice(String* s, uint64_t from, uint64_t to) {  // [from, to) clamped to string bounds
+		to = std::min(to, s->size);
+		from = std::min(from, to);
+		auto r = make(to - from);
+		memcpy(r->data, s->data + from, to - from);
+		return r;
+	}
+	static int64_t compare(String* a, String* b) {  // lexicographic by bytes, -1, 0 or 1
+		auto r = memcmp(a->data, b->data, std::min(a->size, b->size));
+		if (r)
+			return r < 0 ? -1 : 1;
+		return a->size < b->size ? -1 : a->size > b->size ? 1 : 0;
+	}
+	static int64_t hash(String* s) {
+		return hash_map::hash_bytes(s->data, s->size);
+	}
+	static void copy_fields(void* dst, void* src) {
+		auto d = reinterpret_cast<String*>(dst);
+		auto s = reinterpret_cast<String*>(src);
+		allocate_bytes(d, s->size);
+		memcpy(d->data, s->data, s->size);
+	}
+	static void dispose(void* ptr) {
+		auto s = reinterpret_cast<String*>(ptr);
+		if (s->data != s->inline_bytes)
+			delete[] reinterpret_cast<int64_t*>(s->data);
+	}
+	static void visit_fields(void* ptr) {  // buffers are whole words, literals are padded to words too
+		auto s = reinterpret_cast<String*>(ptr);
+		Object::field_visitor->on_buffer(
+			reinterpret_cast<int64_t**>(&s->data),
+			nullptr,
+			(s->size + sizeof(int64_t) - 1) & ~(sizeof(int64_t) - 1),
+			Object::FieldVisitor::RAW);
+	}
+};
+
+void** (*String::cls_dispatcher)(uint64_t) = nullptr;
+void** (*Blob::cls_dispatcher)(uint64_t) = nullptr;
+
+Blob* Blob::make() {
+	auto& vmt = reinterpret_cast<const Object::Vmt*>(cls_dispatcher)[-1];
+	auto r = reinterpret_cast<Blob*>(Object::init_instance(
+		reinterpret_cast<void*>(vmt.allocate(vmt.instance_alloc_size)),
+		vmt.instance_alloc_size));
+	r->dispatcher = cls_dispatcher;
+	return r;
+}
+
+Blob* Blob::map_file(String* file_name) {  // items past the end of file are zeros
+	uint64_t bytes = 0;
+	auto data = reinterpret_cast<int64_t*>(::map_file(string(file_name->data, file_name->size).c_str(), bytes, map_granularity()));
+	if (!data)
+		return nullptr;
+	data[-2] = bytes;
+	buffer_counter(data) = MAPPED_BUFFER | 1;
+	auto r = make();
+	r->data = data;
+	r->size = (bytes + sizeof(int64_t) - 1) / sizeof(int64_t);
+	r->capacity = 0;  // shared with the file, the first write makes pages private
+	r->inline_items[0] = reinterpret_cast<int64_t>(data);
+	return r;
+}
+
+// Runtime part of sys_File: a read-only or write-only handle that streams through one large buffer,
+// so files of any size are processed in fixed memory.
+// The buffer holds read-ahead bytes [pos, end) or pending writes [0, end).
+// Transfers of at least BUFFER_SIZE bytes bypass the buffer.
+// Handles are not shared: copies are closed files, and heap images can't hold files.
+struct File : Object {
+	int64_t handle;
+	char* buffer;  // BUFFER_SIZE bytes aligned for O_DIRECT
+	uint64_t pos;
+	uint64_t end;
+	uint64_t flags;  // WRITE, DIRECT and OPENED
+
+	static constexpr uint64_t WRITE = 1;  // create or truncate, otherwise read
+	static constexpr uint64_t DIRECT = 2;  // bypass the OS page cache where supported, dropped on the first unaligned transfer
+	static constexpr uint64_t OPENED = uint64_t(1) << 8;
+	static constexpr uint64_t BUFFER_SIZE = 1 << 20;
+	static constexpr uint64_t ALIGNMENT = 4096;
+	static void** (*cls_dispatcher)(uint64_t);  // sys_File dispatcher of the running module, set in `execute`
+
+	static int64_t os_read(File* f, char* dst, uint64_t size) {
+#ifdef _WIN32
+		return _read(int(f->handle), dst, unsigned(std::min<uint64_t>(size, 1 << 30)));
+#else
+		return ::read(int(f->handle), dst, size);
+#endif
+	}
+	static int64_t os_write(File* f, const char* src, uint64_t size) {
+#ifdef _WIN32
+		return _write(int(f->handle), src, unsigned(std::min<uint64_t>(size, 1 << 30)));
+#else
+		return ::write(int(f->handle), src, size);
+#endif
+	}
+	static void allow_unaligned(File* f, uint64_t size) {
+		if (!(f->flags & DIRECT) || size % ALIGNMENT == 0)
+			return;
+		f->flags &= ~DIRECT;
+#if !defined(_WIN32) && defined(O_DIRECT)
+		fcntl(int(f->handle), F_SETFL, fcntl(int(f->handle), F_GETFL) & ~O_DIRECT);
+#endif
+	}
+	static bool write_all(File* f, const char* src, uint64_t size) {
+		allow_unaligned(f, size);
+		while (size) {
+			auto n = os_write(f, src, size);
+			if (n <= 0)
+				return false;
+			src += n;
+			size -= n;
+		}
+		return true;
+	}
+	static int64_t read_full(File* f, char* dst, uint64_t size) {  // stops short only at the end of file
+		allow_unaligned(f, size);
+		uint64_t done = 0;
+		while (done < size) {
+			auto n = os_read(f, dst + done, size - done);
+			if (n < 0)
+				return -1;
+			if (n == 0)
+				break;
+			done += n;
+		}
+		return done;
+	}
+
+	// Returns retained file or null. `flags` is a combination of WRITE and DIRECT.
+	static File* open(String* file_name, int64_t flags) {
+		auto name = string(file_name->data, file_name->size);
+#ifdef _WIN32
+		int handle = (flags & WRITE)
+			? _open(name.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE)
+			: _open(name.c_str(), _O_RDONLY | _O_BINARY | _O_SEQUENTIAL);
+		flags &= ~DIRECT;
+#else
+		int os_flags = (flags & WRITE) ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY;
+#ifdef O_DIRECT
+		if (flags & DIRECT)
+			os_flags |= O_DIRECT;
+#else
+		flags &= ~DIRECT;
+#endif
+		int handle = ::open(name.c_str(), os_flags, 0644);
+#ifdef O_DIRECT
+		if (handle < 0 && (flags & DIRECT)) {  // file system doesn't support it
+			flags &= ~DIRECT;
+			handle = ::open(name.c_str(), os_flags & ~O_DIRECT, 0644);
+		}
+#endif
+#ifdef POSIX_FADV_SEQUENTIAL
+		if (handle >= 0)
+			posix_fadvise(handle, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#endif
+		if (handle < 0)
+			return nullptr;
+		auto& vmt = reinterpret_cast<const Object::Vmt*>(cls_dispatcher)[-1];
+		auto r = reinterpret_cast<File*>(Object::init_instance(
+			reinterpret_cast<void*>(vmt.allocate(vmt.instance_alloc_size)),
+			vmt.instance_alloc_size));
+		r->dispatcher = cls_dispatcher;
+		r->handle = handle;
+		r->buffer = static_cast<char*>(operator new(BUFFER_SIZE, std::align_val_t(ALIGNMENT)));
+		r->flags = OPENED | (flags & (WRITE | DIRECT));
+		return r;
+	}
+	static bool flush(File* f) {
+		if ((f->flags & (OPENED | WRITE)) != (OPENED | WRITE))
+			return false;
+		auto size = f->end;
+		f->end = 0;
+		return write_all(f, f->buffer, size);
+	}
+	// Reads up to `size` bytes to `dst` bytes starting at `offset`, extending `dst` if needed.
+	// Returns the number of bytes read, that is less than `size` only at the end of file, or -1 on error.
+	static int64_t read(File* f, Blob* dst, int64_t offset, int64_t size) {
+		if ((f->flags & (OPENED | WRITE)) != OPENED || offset < 0 || size < 0)
+			return -1;
+		if (size == 0)
+			return 0;
+		auto prev_size = dst->size;
+		auto needed = (uint64_t(offset + size) + sizeof(int64_t) - 1) / sizeof(int64_t);
+		if (needed > dst->size)
+			Blob::insert_items(dst, dst->size, needed - dst->size);
+		auto to = reinterpret_cast<char*>(Blob::unshare(dst)) + offset;
+		uint64_t done = 0;
+		while (done < uint64_t(size)) {
+			if (f->pos == f->end) {
+				auto rest = uint64_t(size) - done;
+				if (rest >= BUFFER_SIZE && !(f->flags & DIRECT)) {
+					auto n = read_full(f, to + done, rest);
+					if (n < 0)
+						return -1;
+					done += n;
+					break;
+				}
+				auto n = read_full(f, f->buffer, BUFFER_SIZE);
+				if (n <= 0) {
+					if (n < 0)
+						return -1;
+					break;
+				}
+				f->pos = 0;
+				f->end = n;
+			}
+			auto n = std::min(uint64_t(size) - done, f->end - f->pos);
+			memcpy(to + done, f->buffer + f->pos, n);
+			f->pos += n;
+			done += n;
+		}
+		dst->size = std::max(prev_size, (offset + done + sizeof(int64_t) - 1) / sizeof(int64_t));
+		return done;
+	}
+	// Writes `size` bytes of `src` starting at `offset`, clamped to the blob bytes.
+	// Returns the number of bytes written or -1 on error.
+	static int64_t write(File* f, Blob* src, int64_t offset, int64_t size) {
+		if ((f->flags & (OPENED | WRITE)) != (OPENED | WRITE) || offset < 0 || size < 0)
+			return -1;
+		auto bytes = src->size * sizeof(int64_t);
+		if (uint64_t(offset) >= bytes)
+			return 0;
+		size = std::min(uint64_t(size), bytes - offset);
+		auto from = reinterpret_cast<const char*>(src->data) + offset;
+		if (f->end + size > BUFFER_SIZE) {
+			if (!flush(f))
+				return -1;
+			if (uint64_t(size) >= BUFFER_SIZE && !(f->flags & DIRECT))
+				return write_all(f, from, size) ? size : -1;
+		}
+		for (uint64_t done = 0; done < uint64_t(size);) {
+			auto n = std::min(uint64_t(size) - done, BUFFER_SIZE - f->end);
+			memcpy(f->buffer + f->end, from + done, n);
+			f->end += n;
+			done += n;
+			if (f->end == BUFFER_SIZE && !flush(f))
+				return -1;
+		}
+		return size;
+	}
+	// Moves to the absolute `position`, returns it or -1 on error.
+	static int64_t seek(File* f, int64_t position) {
+		if (!(f->flags & OPENED) || position < 0)
+			return -1;
+		if ((f->flags & WRITE) && !flush(f))
+			return -1;
+		f->pos = f->end = 0;
+		allow_unaligned(f, position);
+#ifdef _WIN32
+		return _lseeki64(int(f->handle), position, SEEK_SET);
+#else
+		return lseek(int(f->handle), position, SEEK_SET);
+#endif
+	}
+
+	static void copy_fields(void* dst, void*) {
+		auto d = reinterpret_cast<File*>(dst);
+		d->handle = 0;
+		d->buffer = nullptr;
+		d->pos = d->end = d->flags = 0;
+	}
+	static void dispose(void* ptr) {
+		auto f = reinterpret_cast<File*>(ptr);
+		if (!(f->flags & OPENED))
+			return;
+		flush(f);
+#ifdef _WIN32
+		_close(int(f->handle));
+#else
+		close(int(f->handle));
+#endif
+		operator delete(f->buffer, std::align_val_t(ALIGNMENT));
+	}
+	static void visit_fields(void*) {
+		Object::field_visitor->on_unsupported();
+	}
+};
+
+void** (*File::cls_dispatcher)(uint64_t) = nullptr;
+
+// Runtime part of sys_ByteBuffer: bytes with an exact length.
+// Laid out as Blob, but `size` is in bytes, while `capacity` counts words of a Blob-style buffer,
+// so `build_intrinsic` and heap images handle both alike. Buffers are never shared, copies copy bytes.
+// Typed accessors read and write unaligned little- or big-endian values, out of bounds reads return 0.
+struct ByteBuffer : Object {
+	uint64_t size;  // in bytes
+	char* data;
+	uint64_t capacity;  // in words
+	int64_t inline_words[8];
+
+	static constexpr uint64_t INLINE_CAPACITY = sizeof(inline_words) / sizeof(int64_t);
+
+	static uint64_t words(uint64_t bytes) {
+		return (bytes + sizeof(int64_t) - 1) / sizeof(int64_t);
+	}
+	static void free_data(ByteBuffer* b) {
+		auto data = reinterpret_cast<int64_t*>(b->data);
+		if (data && data != b->inline_words && --Blob::buffer_counter(data) == 0)
+			delete[] (data - 1);
+	}
+	static void allocate(ByteBuffer* b, uint64_t capacity) {  // keeps `size` bytes
+		auto data = capacity <= INLINE_CAPACITY ? b->inline_words : Blob::new_buffer(capacity);
+		if (data == reinterpret_cast<int64_t*>(b->data))
+			return;
+		if (b->size)
+			memcpy(data, b->data, b->size);
+		free_data(b);
+		b->data = reinterpret_cast<char*>(data);
+		b->capacity = data == b->inline_words ? INLINE_CAPACITY : capacity;
+	}
+	static void resize(ByteBuffer* b, uint64_t size) {  // new bytes are zeros
+		if (size > b->size) {
+			if (words(size) > b->capacity)
+				allocate(b, std::max(words(size), b->capacity * 2));
+			memset(b->data + b->size, 0, size - b->size);
+		}
+		b->size = size;
+	}
+	static int64_t get_size(ByteBuffer* b) {
+		return b->size;
+	}
+	template<typename T, bool BIG_ENDIAN_ORDER>
+	static T get(ByteBuffer* b, uint64_t index) {
+		typename std::conditional<sizeof(T) == 1, uint8_t, typename std::conditional<sizeof(T) == 2, uint16_t,
+			typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type>::type>::type bits = 0;
+		if (index >= b->size || sizeof(T) > b->size - index)
+			return T(0);
+		for (size_t i = 0; i < sizeof(T); i++)
+			bits |= decltype(bits)(uint8_t(b->data[index + (BIG_ENDIAN_ORDER ? sizeof(T) - 1 - i : i)])) << (i * 8);
+		T r;
+		memcpy(&r, &bits, sizeof(T));
+		return r;
+	}
+	template<typename T, bool BIG_ENDIAN_ORDER>
+	static void set(ByteBuffer* b, uint64_t index, T val) {
+		if (index >= b->size || sizeof(T) > b->size - index)
+			return;
+		uint64_t bits = 0;
+		memcpy(&bits, &val, sizeof(T));
+		for (size_t i = 0; i < sizeof(T); i++)
+			b->data[index + (BIG_ENDIAN_ORDER ? sizeof(T) - 1 - i : i)] = char(bits >> (i * 8));
+	}
+	// Language ints are int64, so narrow reads are sign-extended, and narrow writes take the low bytes.
+	template<typename T, bool BIG_ENDIAN_ORDER>
+	static int64_t get_int(ByteBuffer* b, uint64_t index) {
+		return get<T, BIG_ENDIAN_ORDER>(b, index);
+	}
+	template<typename T, bool BIG_ENDIAN_ORDER>
+	static void set_int(ByteBuffer* b, uint64_t index, int64_t val) {
+		set<T, BIG_ENDIAN_ORDER>(b, index, T(val));
+	}
+	static bool copy(ByteBuffer* dst, uint64_t dst_index, ByteBuffer* src, uint64_t src_index, uint64_t bytes) {
+		if (src_index > src->size || bytes > src->size - src_index || dst_index > dst->size || bytes > dst->size - dst_index)
+			return false;
+		if (bytes)
+			memmove(dst->data + dst_index, src->data + src_index, bytes);
+		return true;
+	}
+	// Builder part: appends grow capacity geometrically, so assembling n bytes costs O(n).
+	static char* append_space(ByteBuffer* b, uint64_t bytes) {  // returns where to write `bytes` new bytes
+		auto size = b->size + bytes;
+		if (words(size) > b->capacity)
+			allocate(b, std::max(words(size), b->capacity * 2));
+		b->size = size;
+		return b->data + size - bytes;
+	}
+	static void append_byte(ByteBuffer* b, int64_t val) {
+		*append_space(b, 1) = char(val);
+	}
+	static bool append_blob(ByteBuffer* b, Blob* src, uint64_t from_byte, uint64_t bytes) {
+		auto src_bytes = src->size * sizeof(int64_t);
+		if (from_byte > src_bytes || bytes > src_bytes - from_byte)
+			return false;
+		if (bytes) {
+			auto at = append_space(b, bytes);  // before reading `src`, which can't be `b`
+			memcpy(at, reinterpret_cast<char*>(src->data) + from_byte, bytes);
+		}
+		return true;
+	}
+	static void append_buffer(ByteBuffer* b, ByteBuffer* src) {
+		auto bytes = src->size;
+		if (bytes) {
+			auto at = append_space(b, bytes);
+			memcpy(at, src->data, bytes);  // `src` can be `b`, its data got moved already
+		}
+	}
+	static void append_int(ByteBuffer* b, int64_t val) {  // decimal
+		char text[number_text::MAX_INT_CHARS];
+		auto size = number_text::format_int(val, text);
+		memcpy(append_space(b, size), text, size);
+	}
+	static void append_double(ByteBuffer* b, double val) {  // shortest text that reads back to the same value
+		char text[number_text::MAX_DOUBLE_CHARS];
+		auto size = number_text::format_double(val, text);
+		memcpy(append_space(b, size), text, size);
+	}
+	// Number text at byte offsets, see number_text. Writes return the offset past the text, or -1 if `at` is past the end,
+	// and extend the buffer as needed. Parsing returns 0 if there's no number at `at`.
+	static int64_t put_text(ByteBuffer* b, uint64_t at, const char* text, size_t size) {
+		if (at > b->size)
+			return -1;
+		if (at + size > b->size)
+			append_space(b, at + size - b->size);
+		memcpy(b->data + at, text, size);
+		return at + size;
+	}
+	static int64_t put_int(ByteBuffer* b, uint64_t at, int64_t val) {
+		char text[number_text::MAX_INT_CHARS];
+		return put_text(b, at, text, number_text::format_int(val, text));
+	}
+	static int64_t put_double(ByteBuffer* b, uint64_t at, double val) {
+		char text[number_text::MAX_DOUBLE_CHARS];
+		return put_text(b, at, text, number_text::format_double(val, text));
+	}
+	static int64_t parse_int(ByteBuffer* b, uint64_t at) {
+		int64_t r = 0;
+		if (at < b->size)
+			number_text::parse_int(b->data + at, b->size - at, r);
+		return r;
+	}
+	static double parse_double(ByteBuffer* b, uint64_t at) {
+		double r = 0;
+		if (at < b->size)
+			number_text::parse_double(b->data + at, b->size - at, r);
+		return r;
+	}
+	static int64_t number_end(ByteBuffer* b, uint64_t at) {  // offset past the number text at `at`, or `at` if none
+		double unused;
+		return at < b->size ? at + number_text::parse_double(b->data + at, b->size - at, unused) : at;
+	}
+	// Hands the bytes over to a new Blob of `words(size)` items with zeros past the end, and leaves `b` empty.
+	// Heap buffers are Blob-style, so they move without copying.
+	static Blob* finish(ByteBuffer* b) {
+		auto r = Blob::make();
+		if (!b->size)
+			return r;
+		auto items = words(b->size);
+		memset(b->data + b->size, 0, items * sizeof(int64_t) - b->size);
+		if (b->data == reinterpret_cast<char*>(b->inline_words)) {
+			r->data = r->inline_items;
+			r->capacity = Blob::INLINE_CAPACITY;
+			memcpy(r->inline_items, b->inline_words, items * sizeof(int64_t));
+		} else {
+			r->data = reinterpret_cast<int64_t*>(b->data);
+			r->capacity = b->capacity;
+		}
+		r->size = items;
+		b->data = nullptr;
+		b->size = b->capacity = 0;
+		return r;
+	}
+
+	static void copy_fields(void* dst, void* src) {
+		auto d = reinterpret_cast<ByteBuffer*>(dst);
+		auto s = reinterpret_cast<ByteBuffer*>(src);
+		d->size = 0;
+		d->data = nullptr;
+		d->capacity = 0;
+		if (s->size) {
+			allocate(d, words(s->size));
+			memcpy(d->data, s->data, s->size);
+			d->size = s->size;
+		}
+	}
+	static void dispose(void* ptr) {
+		free_data(reinterpret_cast<ByteBuffer*>(ptr));
+	}
+	static void visit_fields(void* ptr) {
+		auto b = reinterpret_cast<ByteBuffer*>(ptr);
+		Object::field_visitor->on_buffer(
+			reinterpret_cast<int64_t**>(&b->data),
+			&b->capacity,
+			words(b->size) * sizeof(int64_t),
+			Object::FieldVisitor::RAW);
+	}
+};
+
+// Runtime part of sys_Rope: immutable bytes in a shared rope::Node tree, so appends, concatenation and slicing
+// take O(log n) and copies take O(1). Leaves pin Blob buffers, except short inline Blobs get copied to own buffers.
+struct Rope : Object {
+	rope::Node* root;
+
+	static void** (*cls_dispatcher)(uint64_t);  // sys_Rope dispatcher of the running module, set in `execute`
+
+	static Rope* make() {
+		auto& vmt = reinterpret_cast<const Object::Vmt*>(cls_dispatcher)[-1];
+		auto r = reinterpret_cast<Rope*>(Object::init_instance(
+			reinterpret_cast<void*>(vmt.allocate(vmt.instance_alloc_size)),
+			vmt.instance_alloc_size));
+		r->dispatcher = cls_dispatcher;
+		return r;
+	}
+	static void set_root(Rope* r, rope::Node* root) {  // takes over `root`
+		rope::release(r->root, Blob::release_buffer);
+		r->root = root;
+	}
+	static int64_t get_size(Rope* r) {
+		return rope::size(r->root);
+	}
+	static int64_t get_at(Rope* r, uint64_t index) {  // byte, or -1 if out of bounds
+		return rope::byte_at(r->root, index);
+	}
+	static bool append_blob(Rope* r, Blob* src, uint64_t from_byte, uint64_t bytes) {
+		auto src_bytes = src->size * sizeof(int64_t);
+		if (from_byte > src_bytes || bytes > src_bytes - from_byte)
+			return false;
+		if (!bytes)
+			return true;
+		int64_t* buffer;
+		const char* data;
+		if (src->data == src->inline_items) {
+			buffer = Blob::new_buffer(ByteBuffer::words(bytes));
+			data = reinterpret_cast<char*>(buffer);
+			memcpy(buffer, reinterpret_cast<char*>(src->data) + from_byte, bytes);
+		} else {
+			buffer = Blob::share(src);
+			data = reinterpret_cast<char*>(src->data) + from_byte;
+		}
+		auto leaf = rope::leaf(data, bytes, buffer);
+		set_root(r, rope::concat(r->root, leaf));
+		rope::release(leaf, Blob::release_buffer);
+		return true;
+	}
+	static void append(Rope* r, Rope* src) {  // `src` can be `r`
+		set_root(r, rope::concat(r->root, src->root));
+	}
+	static Rope* slice(Rope* r, uint64_t from, uint64_t to) {  // [from, to) clamped
+		auto result = make();
+		result->root = rope::slice(r->root, from, to);
+		return result;
+	}
+	// Contiguous copy in a Blob of ByteBuffer::words(size) items with zeros past the end, the rope stays intact.
+	static Blob* finish(Rope* r) {
+		auto result = Blob::make();
+		auto size = rope::size(r->root);
+		if (!size)
+			return result;
+		auto items = ByteBuffer::words(size);
+		Blob::reallocate(result, items);
+		result->size = items;
+		result->data[items - 1] = 0;
+		rope::copy_to(r->root, reinterpret_cast<char*>(result->data));
+		return result;
+	}
+
+	static void copy_fields(void* dst, void* src) {
+		reinterpret_cast<Rope*>(dst)->root = rope::retain(reinterpret_cast<Rope*>(src)->root);
+	}
+	static void dispose(void* ptr) {
+		rope::release(reinterpret_cast<Rope*>(ptr)->root, Blob::release_buffer);
+	}
+	static void visit_fields(void*) {
+		Object::field_visitor->on_unsupported();
+	}
+};
+
+void** (*Rope::cls_dispatcher)(uint64_t) = nullptr;
+
+// Runtime part of sys_Channel: owned objects passed between threads through a lock-free mpsc_queue::Queue.
+// Any thread can send, one thread at a time receives. The queue is made on first use, racing senders agree on it by CAS.
+// Queued objects belong to the channel, a received object belongs to the receiver.
+// Fresh objects are taken over as is, see Generator::channel_send, others are copied.
+// Reference counters are not atomic, so before queuing, the sender isolates the object graph, see Isolator.
+struct Channel : Object {
+	// Makes the graph owned by a sent object share no counters with the rest of the heap:
+	// shared blob buffers get private copies, weak blocks also known outside of the graph are replaced by new ones,
+	// and weaks to objects outside of the graph are cleared, as the receiver couldn't use them anyway.
+	// Fails on objects held by refs from outside and on objects that can't be walked, like maps, ropes and channels.
+	struct Isolator : Object::FieldVisitor {
+		vector<Object*> objects;
+		unordered_set<Object*> in_graph;
+		vector<Object::Weak**> weaks;
+		bool supported = true;
+
+		void on_object_field(Object** field) override {
+			auto obj = *field;
+			if (!obj || size_t(obj) < 256)
+				return;
+			auto counter = (obj->counter & CTR_WEAKLESS) != 0
+				? obj->counter
+				: reinterpret_cast<Object::Weak*>(obj->counter)->org_counter;
+			if (counter / CTR_STEP != 1)  // also rejects immortal objects of heap images
+				supported = false;
+			else if (in_graph.insert(obj).second)
+				objects.push_back(obj);
+		}
+		void on_weak_field(Object::Weak** field) override {
+			if (*field && size_t(*field) >= 256)
+				weaks.push_back(field);
+		}
+		void on_blob(Blob* container) override {  // items of views and copies get private buffers
+			Blob::unshare(container);
+		}
+		void on_buffer(int64_t** field, uint64_t* capacity, size_t size, Items items) override {
+			if (items == OWNS) {
+				for (auto i = reinterpret_cast<Object**>(*field), term = i + size / sizeof(Object*); i < term; i++)
+					on_object_field(i);
+			} else if (items == WEAKS) {
+				for (auto i = reinterpret_cast<Object::Weak**>(*field), term = i + size / sizeof(Object::Weak*); i < term; i++)
+					on_weak_field(i);
+			}
+		}
+		void on_unsupported() override {
+			supported = false;
+		}
+		bool isolate(Object* root) {
+			on_object_field(&root);
+			for (size_t i = 0; i < objects.size() && supported; i++)
+				reinterpret_cast<const Object::Vmt*>(objects[i]->dispatcher)[-1].visit_ref_fields(objects[i]);
+			if (!supported)
+				return false;
+			unordered_map<Object::Weak*, int64_t> inner_weaks;  // weak block of a graph object -> weaks of the graph to it
+			for (auto w : weaks) {
+				if (in_graph.count((*w)->target)) {
+					inner_weaks[*w]++;
+				} else {
+					Object::release_weak(*w);
+					*w = nullptr;
+				}
+			}
+			unordered_map<Object::Weak*, Object::Weak*> replaced;
+			for (auto obj : objects) {
+				if (obj->counter & CTR_WEAKLESS)
+					continue;
+				auto wb = reinterpret_cast<Object::Weak*>(obj->counter);
+				auto inner = inner_weaks[wb] + 1;  // with the one from `obj`
+				if (wb->wb_counter == inner)
+					continue;
+				auto fresh = reinterpret_cast<Object::Weak*>(new char[sizeof(Object::Weak)]);
+				leak_detector_ref(1);
+				fresh->target = obj;
+				fresh->wb_counter = inner;
+				fresh->org_counter = wb->org_counter;
+				obj->counter = reinterpret_cast<uintptr_t>(fresh);
+				wb->target = nullptr;  // weaks of the sender see the object gone
+				wb->wb_counter -= inner;
+				replaced[wb] = fresh;
+			}
+			if (!replaced.empty()) {
+				for (auto w : weaks) {
+					auto it = *w ? replaced.find(*w) : replaced.end();
+					if (it != replaced.end())
+						*w = it->second;
+				}
+			}
+			return true;
+		}
+	};
+
+	std::atomic<mpsc_queue::Queue*> queue;
+
+	static mpsc_queue::Queue* get_queue(Channel* c) {
+		auto r = c->queue.load(std::memory_order_acquire);
+		if (r)
+			return r;
+		auto fresh = new mpsc_queue::Queue;
+		if (c->queue.compare_exchange_strong(r, fresh, std::memory_order_acq_rel))
+			return fresh;
+		delete fresh;
+		return r;
+	}
+	static bool send(Channel* c, Object* val) {  // the sender keeps `val`, the channel gets a copy
+		return val && send_moved(c, Object::copy(val));
+	}
+	// Takes over `val` that no one else holds. Returns false and releases `val` if its graph can't be isolated.
+	static bool send_moved(Channel* c, Object* val) {
+		if (!val)
+			return false;
+		Isolator isolator;
+		auto prev_visitor = Object::field_visitor;
+		Object::field_visitor = &isolator;
+		bool isolated = isolator.isolate(val);
+		Object::field_visitor = prev_visitor;
+		if (!isolated) {
+			Object::release(val);
+			return false;
+		}
+		get_queue(c)->push(val);
+		return true;
+	}
+	static Object* receive(Channel* c) {  // waits for an object, null once the channel is closed and drained
+		return static_cast<Object*>(get_queue(c)->pop());
+	}
+	static Object* try_receive(Channel* c) {  // null if nothing is queued
+		return static_cast<Object*>(get_queue(c)->try_pop());
+	}
+	static void close(Channel* c) {
+		get_queue(c)->close();
+	}
+
+	static void copy_fields(void* dst, void* src) {  // copies start empty
+		reinterpret_cast<Channel*>(dst)->queue.store(nullptr, std::memory_order_relaxed);
+	}
+	static void dispose(void* ptr) {
+		auto q = reinterpret_cast<Channel*>(ptr)->queue.load(std::memory_order_acquire);
+		if (!q)
+			return;
+		while (auto val = q->try_pop())
+			Object::release(static_cast<Object*>(val));
+		delete q;
+	}
+	static void visit_fields(void*) {
+		Object::field_visitor->on_unsupported();
+	}
+};
+
+// Host thread for tests of sys_Channel across threads: sends copies of objects received from `from` to `to`,
+// and closes `to` once `from` is closed and drained. Copying and releasing touch all counters of received graphs.
+void foreign_test_echo(Channel* from, Channel* to) {
+	std::thread([from, to] {
+		while (auto val = Channel::receive(from)) {
+			Channel::send(to, val);
+			Object::release(val);
+		}
+		Channel::close(to);
+	}).detach();
+}
+
+// Runtime part of sys_Deque family: a ring buffer of int64 values or owned objects.
+// `capacity` is zero or a power of two, item `i` lives at `data[(head + i) & (capacity - 1)]`, free slots are zeros.
+// Buffers are Blob-style but never shared, so copies copy items.
+// Heap images store the whole ring, and `head` and `capacity` stay valid after load.
+struct Deque : Object {
+	uint64_t size;
+	int64_t* data;
+	uint64_t capacity;
+	uint64_t head;
+
+	enum Items { INTS, OWNS };
+
+	int64_t& at(uint64_t index) {
+		return data[(head + index) & (capacity - 1)];
+	}
+	static void free_data(Deque* d) {
+		if (d->data && --Blob::buffer_counter(d->data) == 0)
+			delete[] (d->data - 1);
+	}
+	static void grow(Deque* d) {  // doubles the capacity, unrolling items to the buffer start
+		auto capacity = d->capacity ? d->capacity * 2 : 4;
+		auto data = Blob::new_buffer(capacity);
+		for (uint64_t i = 0; i < d->size; i++)
+			data[i] = d->at(i);
+		memset(data + d->size, 0, sizeof(int64_t) * (capacity - d->size));
+		free_data(d);
+		d->data = data;
+		d->capacity = capacity;
+		d->head = 0;
+	}
+	static void push(Deque* d, int64_t item, bool front) {
+		if (d->size == d->capacity)
+			grow(d);
+		if (front)
+			d->head = (d->head - 1) & (d->capacity - 1);
+		d->size++;
+		d->at(front ? 0 : d->size - 1) = item;
+	}
+	static int64_t pop(Deque* d, bool front) {  // the freed slot is zeroed
+		if (!d->size)
+			return 0;
+		auto& slot = d->at(front ? 0 : d->size - 1);
+		auto r = slot;
+		slot = 0;
+		if (front)
+			d->head = (d->head + 1) & (d->capacity - 1);
+		d->size--;
+		return r;
+	}
+	static int64_t get_size(Deque* d) {
+		return d->size;
+	}
+	static void push_int_back(Deque* d, int64_t val) { push(d, val, false); }
+	static void push_int_front(Deque* d, int64_t val) { push(d, val, true); }
+	static int64_t pop_int_back(Deque* d) { return pop(d, false); }
+	static int64_t pop_int_front(Deque* d) { return pop(d, true); }
+	static int64_t get_int_at(Deque* d, uint64_t index) {  // counting from the front
+		return index < d->size ? d->at(index) : 0;
 	}
-	static Object::Weak* get_weak_at(Blob* b, uint64_t index) {
-		return index < b->size
-			? Object::retain_weak(reinterpret_cast<Object::Weak*>(b->data[index]))
+	// Pushed objects are copied as in Array_setAt.
+	// Popped objects pass the deque ownership to the result, so nothing is copied or retained.
+	static void push_own_back(Deque* d, Object* val) { push(d, reinterpret_cast<int64_t>(Object::copy(val)), false); }
+	static void push_own_front(Deque* d, Object* val) { push(d, reinterpret_cast<int64_t>(Object::copy(val)), true); }
+	static Object* pop_own_back(Deque* d) { return reinterpret_cast<Object*>(pop(d, false)); }
+	static Object* pop_own_front(Deque* d) { return reinterpret_cast<Object*>(pop(d, true)); }
+	static Object* get_own_at(Deque* d, uint64_t index) {
+		return index < d->size
+			? Object::retain(reinterpret_cast<Object*>(d->at(index)))
 			: nullptr;
 	}
-	static void set_ref_at(Blob* b, uint64_t index, Object* val) {
-		if (index < b->size) {
-			auto dst = reinterpret_cast<Object**>(b->data) + index;
-			val = Object::copy(val);
-			Object::release(*dst);
-			*dst = val;
+	template<Items V>
+	static void clear(Deque* d) {
+		while (d->size) {
+			auto item = pop(d, true);
+			if (V == OWNS)
+				Object::release(reinterpret_cast<Object*>(item));
 		}
 	}
-	static void set_weak_at(Blob* b, uint64_t index, Object::Weak* val) {
-		if (index < b->size) {
-			auto dst = reinterpret_cast<Object::Weak**>(b->data) + index;
-			val = Object::retain_weak(val);
-			Object::release_weak(*dst);
-			*dst = val;
+
+	template<Items V>
+	static void copy_fields(void* dst, void* src) {
+		auto d = reinterpret_cast<Deque*>(dst);
+		auto s = reinterpret_cast<Deque*>(src);
+		if (!s->data)
+			return;
+		d->data = Blob::new_buffer(s->capacity);
+		memset(d->data, 0, sizeof(int64_t) * s->capacity);
+		for (uint64_t i = 0; i < s->size; i++) {
+			d->at(i) = V == OWNS
+				? reinterpret_cast<int64_t>(Object::copy_object_field(reinterpret_cast<Object*>(s->at(i))))
+				: s->at(i);
 		}
 	}
-	static void copy_container_fields(void* dst, void* src) {
-		auto d = reinterpret_cast<Blob*>(dst);
-		auto s = reinterpret_cast<Blob*>(src);
-		d->size = s->size;
-		d->data = new int64_t[d->size];
-		memcpy(d->data, s->data, sizeof(int64_t) * d->size);
-	}
-	static void copy_array_fields(void* dst, void* src) {
-		auto d = reinterpret_cast<Blob*>(dst);
-		auto s = reinterpret_cast<Blob*>(src);
-		d->size = s->size;
-		d->data = new int64_t[d->size];
-		for (
-			auto
-				from = reinterpret_cast<Object**>(s->data),
-				to = reinterpret_cast<Object**>(d->data),
-				term = from + d->size;
-			from < term;
-			from++, to++)
-		{
-			*to = Object::copy_object_field(*from);
+	template<Items V>
+	static void dispose(void* ptr) {
+		auto d = reinterpret_cast<Deque*>(ptr);
+		if (V == OWNS) {
+			for (uint64_t i = 0; i < d->size; i++)
+				Object::release(reinterpret_cast<Object*>(d->at(i)));
 		}
+		free_data(d);
 	}
-	static void copy_weak_array_fields(void* dst, void* src) {
-		auto d = reinterpret_cast<Blob*>(dst);
-		auto s = reinterpret_cast<Blob*>(src);
-		d->size = s->size;
-		d->data = new int64_t[d->size];
-		auto to = reinterpret_cast<void**>(d->data);
-		for (
-			auto
-				from = reinterpret_cast<Object::Weak**>(s->data),
-				term = from + d->size;
-			from < term;
-			from++, to++) {
-			Object::copy_weak_field(to, *from);
+	template<Items V>
+	static void visit_fields(void* ptr) {
+		auto d = reinterpret_cast<Deque*>(ptr);
+		Object::field_visitor->on_buffer(
+			&d->data,
+			&d->capacity,
+			sizeof(int64_t) * d->capacity,
+			V == OWNS ? Object::FieldVisitor::OWNS : Object::FieldVisitor::RAW);
+	}
+};
+
+// Relocatable snapshot of an object graph (objects, weak blocks and container buffers).
+// Written by `sys_HeapImage_save`, mapped back by `sys_HeapImage_load` in later runs.
+// Pointers inside image are stored as offsets from its start and listed in the relocation table.
+// Dispatchers are not stored, they are bound by class names to the `!classes` table of the current module.
+// Each class also stores its layout signature, so an image doesn't bind to a class whose fields were reordered or retyped.
+// Loaded objects and weak blocks are immortal and stay in the mapped image till the process end.
+// Container buffers are copied to heap on load, so loaded containers can be modified as usual.
+// Hash maps are not supported, saving a graph containing them fails.
+struct HeapImage {
+	struct ClassEntry {  // `!classes` item, the table ends with null name
+		const char* name;
+		void** (*dispatcher)(uint64_t interface_and_method_ordinal);
+	};
+	struct Header {
+		uint64_t magic;
+		uint64_t size;     // whole image size
+		uint64_t root;     // root object offset
+		uint64_t classes;  // ClassRecord[classes_count] offset
+		uint64_t classes_count;
+		uint64_t relocs;   // uint64_t[relocs_count] offset - locations of pointers to rebase
+		uint64_t relocs_count;
+		uint64_t objects;  // ObjectRecord[objects_count] offset
+		uint64_t objects_count;
+		uint64_t buffers;  // BufferRecord[buffers_count] offset
+		uint64_t buffers_count;
+	};
+	struct ClassRecord {
+		uint64_t name;  // zero-terminated name offset
+		uint64_t instance_size;
+		uint64_t layout;  // zero-terminated layout signature offset, see LayoutProbe
+	};
+	struct ObjectRecord {
+		uint64_t offset;
+		uint64_t class_index;
+	};
+	struct BufferRecord {
+		uint64_t field;     // container `data` field offset
+		uint64_t capacity;  // container `capacity` field offset or NO_CAPACITY
+		uint64_t size;      // in bytes
+	};
+	static constexpr uint64_t NO_CAPACITY = ~uint64_t(0);
+	static constexpr uint64_t MAGIC = 0x336567616d496b41;  // "AkImage3"
+	static ClassEntry* classes;
+	static string path;
+
+	// Layout signature of a class, a char per instance word after the object header: 'o' own pointer, 'w' weak,
+	// 'r', 'a' or 'k' container buffer of raw, own or weak items, 'c' buffer capacity, 's' scalar.
+	// It is taken by visiting a zeroed instance, so it lists exactly the fields that image relocation touches.
+	struct LayoutProbe : Object::FieldVisitor {
+		char* instance = nullptr;
+		string layout;
+
+		void mark(void* field, char kind) {
+			auto word = (reinterpret_cast<char*>(field) - instance) / sizeof(int64_t) - OBJECT_HEADER_WORDS;
+			if (word < layout.size())
+				layout[word] = kind;
+		}
+		void on_object_field(Object** field) override { mark(field, 'o'); }
+		void on_weak_field(Object::Weak** field) override { mark(field, 'w'); }
+		void on_buffer(int64_t** field, uint64_t* capacity, size_t size, Items items) override {
+			mark(field, items == RAW ? 'r' : items == OWNS ? 'a' : 'k');
+			if (capacity)
+				mark(capacity, 'c');
 		}
+		void on_unsupported() override {}  // such classes never get to images
+
+		static constexpr size_t OBJECT_HEADER_WORDS = sizeof(Object) / sizeof(int64_t);
+	};
+	static string layout_of(void** (*dispatcher)(uint64_t)) {
+		auto& vmt = reinterpret_cast<const Object::Vmt*>(dispatcher)[-1];
+		auto words = (vmt.instance_alloc_size + sizeof(int64_t) - 1) / sizeof(int64_t);
+		vector<int64_t> zeroed(words);
+		auto obj = reinterpret_cast<Object*>(zeroed.data());
+		obj->dispatcher = dispatcher;
+		LayoutProbe probe;
+		probe.instance = reinterpret_cast<char*>(obj);
+		probe.layout.assign(words - LayoutProbe::OBJECT_HEADER_WORDS, 's');
+		auto prev_visitor = Object::field_visitor;
+		Object::field_visitor = &probe;
+		vmt.visit_ref_fields(obj);
+		Object::field_visitor = prev_visitor;
+		return probe.layout;
 	}
-	static void dispose_container(void* ptr) {
-		auto p = reinterpret_cast<Blob*>(ptr);
-		delete[] p->data;
+
+	struct Writer : Object::FieldVisitor {
+		enum Kind { OBJECT, WEAK_BLOCK, OWN_BUFFER, WEAK_BUFFER };
+		struct Block {
+			char* src;
+			uint64_t offset;
+			uint64_t size;
+			Kind kind;
+		};
+		enum PtrKind { PTR, COUNTER };  // what to store if target is not in image: null or immortal counter
+		struct Ptr {
+			uint64_t at;
+			void* target;
+			PtrKind kind;
+		};
+		vector<char> image;
+		vector<Block> blocks;
+		size_t current = 0;  // index of block being visited
+		unordered_map<void*, uint64_t> offsets;
+		unordered_map<void*, pair<uint64_t, size_t>> raw_offsets;  // raw buffer start -> offset and size of its longest block
+		vector<Ptr> ptrs;
+		vector<uint64_t> relocs;
+		vector<ObjectRecord> objects;
+		vector<BufferRecord> buffers;
+		bool supported = true;  // cleared by objects that can't be stored
+
+		template<typename T> T* at(uint64_t offset) {
+			return reinterpret_cast<T*>(image.data() + offset);
+		}
+		uint64_t append(const void* data, size_t size) {
+			auto offset = (image.size() + 7) & ~uint64_t(7);
+			image.resize(offset + size);
+			if (size)
+				memcpy(image.data() + offset, data, size);
+			return offset;
+		}
+		uint64_t add_block(void* src, size_t size, Kind kind) {
+			auto it = offsets.find(src);
+			if (it != offsets.end())
+				return it->second;
+			auto offset = append(src, size);
+			offsets.insert({ src, offset });
+			blocks.push_back({ reinterpret_cast<char*>(src), offset, size, kind });
+			return offset;
+		}
+		uint64_t location(void* field) {
+			auto& b = blocks[current];
+			return b.offset + (reinterpret_cast<char*>(field) - b.src);
+		}
+		void on_object_field(Object** field) override {
+			if (*field && size_t(*field) >= 256) {
+				add_block(*field, reinterpret_cast<const Object::Vmt*>((*field)->dispatcher)[-1].instance_alloc_size, OBJECT);
+				ptrs.push_back({ location(field), *field, PTR });
+			}
+		}
+		void on_weak_field(Object::Weak** field) override {
+			if (*field && size_t(*field) >= 256) {
+				add_block(*field, sizeof(Object::Weak), WEAK_BLOCK);
+				ptrs.push_back({ location(field), *field, PTR });
+			}
+		}
+		void on_buffer(int64_t** field, uint64_t* capacity, size_t size, Items items) override {
+			if (!*field)
+				return;
+			auto data = reinterpret_cast<char*>(*field);
+			auto& container = blocks[current];
+			if (data >= container.src && data < container.src + container.size) {  // inline storage stays in object
+				*at<uint64_t>(location(field)) = location(data);
+				relocs.push_back(location(field));
+				visit_items(data, size, items);
+			} else if (items == RAW) {  // blob views share the start of a longer buffer, a longer block serves both
+				auto& block = raw_offsets[data];
+				if (block.second < size || !block.first)
+					block = { append(data, size), size };
+				*at<uint64_t>(location(field)) = block.first;
+				relocs.push_back(location(field));
+				buffers.push_back({ location(field), capacity ? location(capacity) : NO_CAPACITY, size });
+			} else {
+				add_block(data, size, items == OWNS ? OWN_BUFFER : WEAK_BUFFER);
+				ptrs.push_back({ location(field), data, PTR });
+				buffers.push_back({ location(field), capacity ? location(capacity) : NO_CAPACITY, size });
+			}
+		}
+		void on_unsupported() override {
+			supported = false;
+		}
+		void visit_items(char* data, size_t size, Items items) {
+			if (items == OWNS) {
+				for (auto i = reinterpret_cast<Object**>(data), term = i + size / sizeof(Object*); i < term; i++)
+					on_object_field(i);
+			} else if (items == WEAKS) {
+				for (auto i = reinterpret_cast<Object::Weak**>(data), term = i + size / sizeof(Object::Weak*); i < term; i++)
+					on_weak_field(i);
+			}
+		}
+		bool write(Object* root, const char* file_name) {
+			unordered_map<void*, uint64_t> class_by_dispatcher;  // -> index in `classes`
+			for (auto c = classes; c->name; c++)
+				class_by_dispatcher.insert({ reinterpret_cast<void*>(c->dispatcher), c - classes });
+			unordered_map<uint64_t, uint64_t> used_classes;  // index in `classes` -> ClassRecord index
+			vector<ClassRecord> class_records;
+			image.resize(sizeof(Header));
+			auto root_offset = add_block(root, reinterpret_cast<const Object::Vmt*>(root->dispatcher)[-1].instance_alloc_size, OBJECT);
+			for (current = 0; current < blocks.size(); current++) {
+				auto block = blocks[current];
+				switch (block.kind) {
+				case OBJECT: {
+						auto obj = reinterpret_cast<Object*>(block.src);
+						auto cls = class_by_dispatcher.find(reinterpret_cast<void*>(obj->dispatcher));
+						if (cls == class_by_dispatcher.end())
+							return false;
+						auto used = used_classes.insert({ cls->second, class_records.size() });
+						if (used.second)
+							class_records.push_back({ 0, block.size, 0 });
+						objects.push_back({ block.offset, used.first->second });
+						at<Object>(block.offset)->dispatcher = nullptr;
+						at<Object>(block.offset)->counter = Object::CTR_IMMORTAL;
+						if ((obj->counter & Object::CTR_WEAKLESS) == 0)
+							ptrs.push_back({ block.offset + offsetof(Object, counter), reinterpret_cast<void*>(obj->counter), COUNTER });
+						reinterpret_cast<const Object::Vmt*>(obj->dispatcher)[-1].visit_ref_fields(obj);
+						if (!supported)
+							return false;
+					} break;
+				case WEAK_BLOCK: {
+						auto wb = reinterpret_cast<Object::Weak*>(block.src);
+						at<Object::Weak>(block.offset)->wb_counter = Object::CTR_IMMORTAL;
+						at<Object::Weak>(block.offset)->org_counter = Object::CTR_IMMORTAL;
+						if (wb->target)
+							ptrs.push_back({ block.offset + offsetof(Object::Weak, target), wb->target, PTR });
+					} break;
+				case OWN_BUFFER:
+					visit_items(block.src, block.size, OWNS);
+					break;
+				case WEAK_BUFFER:
+					visit_items(block.src, block.size, WEAKS);
+					break;
+				}
+			}
+			for (auto& p : ptrs) {
+				auto target = offsets.find(p.target);
+				if (target != offsets.end()) {
+					*at<uint64_t>(p.at) = target->second;
+					relocs.push_back(p.at);
+				} else {  // weak target or weak block that is not reachable from root
+					*at<uint64_t>(p.at) = p.kind == COUNTER ? Object::CTR_IMMORTAL : 0;
+				}
+			}
+			for (auto& c : used_classes) {
+				auto name = classes[c.first].name;
+				auto layout = layout_of(classes[c.first].dispatcher);
+				class_records[c.second].name = append(name, strlen(name) + 1);
+				class_records[c.second].layout = append(layout.c_str(), layout.size() + 1);
+			}
+			Header header{ MAGIC, 0, root_offset };
+			header.classes = append(class_records.data(), sizeof(ClassRecord) * class_records.size());
+			header.classes_count = class_records.size();
+			header.relocs = append(relocs.data(), sizeof(uint64_t) * relocs.size());
+			header.relocs_count = relocs.size();
+			header.objects = append(objects.data(), sizeof(ObjectRecord) * objects.size());
+			header.objects_count = objects.size();
+			header.buffers = append(buffers.data(), sizeof(BufferRecord) * buffers.size());
+			header.buffers_count = buffers.size();
+			header.size = image.size();
+			*at<Header>(0) = header;
+			auto file = fopen(file_name, "wb");
+			if (!file)
+				return false;
+			bool written = fwrite(image.data(), 1, image.size(), file) == image.size();
+			return fclose(file) == 0 && written;
+		}
+	};
+
+	static bool save(Object* root) {
+		if (!root || path.empty() || !classes)
+			return false;
+		Writer writer;
+		auto prev_visitor = Object::field_visitor;
+		Object::field_visitor = &writer;
+		bool r = writer.write(root, path.c_str());
+		Object::field_visitor = prev_visitor;
+		return r;
 	}
-	static void dispose_array(void* ptr) {
-		auto p = reinterpret_cast<Blob*>(ptr);
-		for (auto ptr = reinterpret_cast<Object**>(p->data), to = ptr + p->size; ptr < to; ptr++)
-			Object::release(*ptr);
-		delete[] p->data;
+
+	// Returns retained root or null if there is no image or it doesn't match the current classes.
+	static Object* load() {
+		if (path.empty() || !classes)
+			return nullptr;
+		uint64_t size = 0;
+		auto image = map_file(path.c_str(), size);
+		if (!image)
+			return nullptr;
+		if (!bind(image, size)) {
+			unmap_file(image, size);
+			return nullptr;
+		}
+		// Image stays mapped: its objects are immortal.
+		return Object::retain(reinterpret_cast<Object*>(image + reinterpret_cast<Header*>(image)->root));
 	}
-	static void dispose_weak_array(void* ptr) {
-		auto p = reinterpret_cast<Blob*>(ptr);
-		for (auto ptr = reinterpret_cast<Object::Weak**>(p->data), to = ptr + p->size; ptr < to; ptr++)
-			Object::release_weak(*ptr);
-		delete[] p->data;
+	static bool bind(char* image, uint64_t size) {
+		auto& header = *reinterpret_cast<Header*>(image);
+		auto table_fits = [&](uint64_t offset, uint64_t count, uint64_t item_size) {
+			return offset <= size && count <= (size - offset) / item_size;
+		};
+		if (size < sizeof(Header) ||
+			header.magic != MAGIC ||
+			header.size != size ||
+			header.root > size - sizeof(Object) ||
+			!table_fits(header.classes, header.classes_count, sizeof(ClassRecord)) ||
+			!table_fits(header.relocs, header.relocs_count, sizeof(uint64_t)) ||
+			!table_fits(header.objects, header.objects_count, sizeof(ObjectRecord)) ||
+			!table_fits(header.buffers, header.buffers_count, sizeof(BufferRecord)))
+			return false;
+		unordered_map<string, void** (*)(uint64_t)> dispatchers;
+		for (auto c = classes; c->name; c++)
+			dispatchers.insert({ c->name, c->dispatcher });
+		vector<void** (*)(uint64_t)> bound_classes;
+		auto class_records = reinterpret_cast<ClassRecord*>(image + header.classes);
+		for (uint64_t i = 0; i < header.classes_count; i++) {
+			auto& rec = class_records[i];
+			if (rec.name >= size || !memchr(image + rec.name, 0, size - rec.name) ||
+				rec.layout >= size || !memchr(image + rec.layout, 0, size - rec.layout))
+				return false;
+			auto it = dispatchers.find(image + rec.name);
+			if (it == dispatchers.end() ||
+				reinterpret_cast<const Object::Vmt*>(it->second)[-1].instance_alloc_size != rec.instance_size ||
+				layout_of(it->second) != image + rec.layout)
+				return false;
+			bound_classes.push_back(it->second);
+		}
+		auto objects = reinterpret_cast<ObjectRecord*>(image + header.objects);
+		for (uint64_t i = 0; i < header.objects_count; i++) {
+			if (objects[i].class_index >= bound_classes.size() || objects[i].offset > size - sizeof(Object))
+				return false;
+		}
+		auto buffers = reinterpret_cast<BufferRecord*>(image + header.buffers);
+		for (uint64_t i = 0; i < header.buffers_count; i++) {
+			if (buffers[i].field > size - sizeof(uint64_t) ||
+				(buffers[i].capacity != NO_CAPACITY && buffers[i].capacity > size - sizeof(uint64_t)) ||
+				buffers[i].size > size ||
+				*reinterpret_cast<uint64_t*>(image + buffers[i].field) > size - buffers[i].size)  // not relocated yet
+				return false;
+		}
+		auto relocs = reinterpret_cast<uint64_t*>(image + header.relocs);
+		for (uint64_t i = 0; i < header.relocs_count; i++) {
+			if (relocs[i] > size - sizeof(uint64_t))
+				return false;
+			*reinterpret_cast<uint64_t*>(image + relocs[i]) += reinterpret_cast<uint64_t>(image);
+		}
+		for (uint64_t i = 0; i < header.objects_count; i++)
+			reinterpret_cast<Object*>(image + objects[i].offset)->dispatcher = bound_classes[objects[i].class_index];
+		for (uint64_t i = 0; i < header.buffers_count; i++) {
+			auto field = reinterpret_cast<int64_t**>(image + buffers[i].field);
+			auto items = buffers[i].size / sizeof(int64_t);
+			auto data = buffers[i].capacity == NO_CAPACITY
+				? new int64_t[items]
+				: Blob::new_buffer(items);  // containers share buffers on copy, see Blob
+			memcpy(data, *field, buffers[i].size);
+			*field = data;
+			if (buffers[i].capacity != NO_CAPACITY)
+				*reinterpret_cast<uint64_t*>(image + buffers[i].capacity) = items;
+		}
+		return true;
 	}
 };
 
+HeapImage::ClassEntry* HeapImage::classes = nullptr;
+string HeapImage::path;
+
+void set_heap_image_path(string path) {
+	HeapImage::path = move(path);
+}
+
 struct MethodInfo {
 	llvm::FunctionType* type;
 	size_t ordinal;  // index in vmt
@@ -513,6 +2329,9 @@ struct ClassInfo {
 	llvm::Function* initializer; // void(void*)
 	llvm::Function* copier;      // void(void* dst, void* src);
 	llvm::Function* dispose;      // void(void*);
+	llvm::Function* visitor;      // void(void*);
+	llvm::Function* allocate;     // int(int size);
+	llvm::Function* free;         // void(int ptr);
 	llvm::Function* dispatcher;      // void*(void*obj, uint64 inerface_and_method_ordinal);
 	vector<llvm::Constant*> vmt_fields; // pointers to methods. size <= 2^16, at index 0 - inteface id for dynamic cast
 	uint64_t interface_ordinal;  // 48_bit_random << 16
@@ -554,6 +2373,9 @@ struct Generator : ast::ActionScanner {
 	llvm::Function* fn_retain;   // void(Obj*) no_throw
 	llvm::Function* fn_retain_weak;   // void(WB*) no_throw
 	llvm::Function* fn_allocate; // Obj*(size_t)
+	llvm::Function* fn_init_instance; // Obj*(Obj*, size_t) - for classes with custom allocators
+	llvm::Function* fn_allocate_raw;  // int(int size) - default vmt allocator
+	llvm::Function* fn_free_raw;      // void(int ptr) - default vmt deallocator
 	llvm::Function* fn_copy;   // Obj*(Obj*)
 	llvm::Function* fn_mk_weak;   // WB*(Obj*)
 	llvm::Function* fn_deref_weak;   // intptr_aka_?obj* (WB*)
@@ -561,6 +2383,12 @@ struct Generator : ast::ActionScanner {
 	llvm::Function* fn_copy_weak_field;   // void(WB** dst, WB* src)
 	llvm::PointerType* fn_copy_fixer_type;  // void (*)(Obj*)
 	llvm::Function* fn_reg_copy_fixer;      // void (Obj*, fn_fixer_type)
+	llvm::Function* fn_visit_object_field;  // void(Obj** field)
+	llvm::Function* fn_visit_weak_field;    // void(WB** field)
+	llvm::Function* fn_unshare_blob;        // void*(Obj* blob), Blob::unshare
+	llvm::Function* fn_take_array_items;    // void*(Obj* array), Blob::take_items
+	llvm::Function* fn_return_array_items;  // void(Obj* array, void* items, size_t size), Blob::return_items
+	llvm::Function* fn_channel_send_moved;  // bool(Obj* channel, Obj* val), Channel::send_moved
 	std::default_random_engine random_generator;
 	std::uniform_int_distribution<uint64_t> uniform_uint64_distribution;
 	unordered_set<uint64_t> assigned_interface_ids;
@@ -570,6 +2398,24 @@ struct Generator : ast::ActionScanner {
 	unordered_map<weak<ast::MkLambda>, llvm::Function*> compiled_functions;
 	llvm::Constant* null_weak;
 
+	// Platform functions that are lowered to inline IR instead of calls, see build_intrinsic.
+	enum class Intrinsic { ContainerSize, BlobGetAt, BlobSetAt, BlobGetByteAt, BlobSetByteAt, ArrayGetAt, WeakArrayGetAt, ArrayMoveAt, StringGetAt, ByteBufferGet, ByteBufferSet };
+	unordered_map<pin<ast::Function>, Intrinsic> intrinsics;
+	struct ByteFormat {  // value accessed by ByteBufferGet/Set
+		unsigned bytes;
+		bool big_endian;
+		bool is_float;
+	};
+	unordered_map<pin<ast::Function>, ByteFormat> byte_formats;
+	pin<ast::Function> array_set_at;  // lowered to ArrayMoveAt when stored value is a fresh object
+	pin<ast::Function> array_sort;  // always lowered by build_sort
+	pin<ast::Function> channel_send;  // lowered to fn_channel_send_moved when sent value is a fresh object
+	llvm::MDNode* tbaa_container_size;  // Container._size
+	llvm::MDNode* tbaa_container_data;  // Container._data
+	llvm::MDNode* tbaa_container_capacity;  // Container._capacity
+	llvm::MDNode* tbaa_container_item;  // items `_data` points to
+	unordered_map<string, llvm::GlobalVariable*> string_literals;  // immortal sys_String instances, filled in `build_string_literals`
+
 	static constexpr size_t OBJ_PREFIX_FIELDS = 2;  // pointer to dispatcher+couter_or_weak
 
 	Generator(ltm::pin<ast::Ast> ast)
@@ -592,6 +2438,16 @@ struct Generator : ast::ActionScanner {
 		weak_block_ptr = llvm::StructType::get(*context, { void_ptr_type, tp_int_ptr, tp_int_ptr })->getPointerTo();
 		empty_mtable = make_const_array("empty_mtable", { llvm::Constant::getNullValue(void_ptr_type) });
 		null_weak = llvm::Constant::getNullValue(weak_block_ptr);
+		llvm::MDBuilder md(*context);
+		auto tbaa_root = md.createTBAARoot("container");
+		auto mk_tbaa_tag = [&](const char* name) {
+			auto type = md.createTBAAScalarTypeNode(name, tbaa_root);
+			return md.createTBAAStructTagNode(type, type, 0);
+		};
+		tbaa_container_size = mk_tbaa_tag("size");
+		tbaa_container_data = mk_tbaa_tag("data");
+		tbaa_container_capacity = mk_tbaa_tag("capacity");
+		tbaa_container_item = mk_tbaa_tag("item");
 
 		fn_retain = llvm::Function::Create(
 			llvm::FunctionType::get(void_type, { obj_ptr }, false),
@@ -618,6 +2474,21 @@ struct Generator : ast::ActionScanner {
 			llvm::Function::ExternalLinkage,
 			"alloc",
 			*module);
+		fn_init_instance = llvm::Function::Create(
+			llvm::FunctionType::get(obj_ptr, { obj_ptr, int_type }, false),
+			llvm::Function::ExternalLinkage,
+			"init_instance",
+			*module);
+		fn_allocate_raw = llvm::Function::Create(
+			llvm::FunctionType::get(int_type, { int_type }, false),
+			llvm::Function::ExternalLinkage,
+			"allocate_raw",
+			*module);
+		fn_free_raw = llvm::Function::Create(
+			llvm::FunctionType::get(void_type, { int_type }, false),
+			llvm::Function::ExternalLinkage,
+			"free_raw",
+			*module);
 		fn_copy = llvm::Function::Create(
 			llvm::FunctionType::get(obj_ptr, { obj_ptr }, false),
 			llvm::Function::ExternalLinkage,
@@ -639,6 +2510,16 @@ struct Generator : ast::ActionScanner {
 			llvm::Function::ExternalLinkage,
 			"reg_copy_fixer",
 			*module);
+		fn_visit_object_field = llvm::Function::Create(
+			llvm::FunctionType::get(void_type, { obj_ptr->getPointerTo() }, false),
+			llvm::Function::ExternalLinkage,
+			"visit_object_field",
+			*module);
+		fn_visit_weak_field = llvm::Function::Create(
+			llvm::FunctionType::get(void_type, { weak_block_ptr->getPointerTo() }, false),
+			llvm::Function::ExternalLinkage,
+			"visit_weak_field",
+			*module);
 		fn_mk_weak = llvm::Function::Create(
 			llvm::FunctionType::get(weak_block_ptr, { obj_ptr }, false),
 			llvm::Function::ExternalLinkage,
@@ -649,6 +2530,26 @@ struct Generator : ast::ActionScanner {
 			llvm::Function::ExternalLinkage,
 			"deref_weak",
 			*module);
+		fn_unshare_blob = llvm::Function::Create(
+			llvm::FunctionType::get(void_ptr_type, { obj_ptr }, false),
+			llvm::Function::ExternalLinkage,
+			"unshare_blob",
+			*module);
+		fn_take_array_items = llvm::Function::Create(
+			llvm::FunctionType::get(void_ptr_type, { obj_ptr }, false),
+			llvm::Function::ExternalLinkage,
+			"take_array_items",
+			*module);
+		fn_return_array_items = llvm::Function::Create(
+			llvm::FunctionType::get(void_type, { obj_ptr, void_ptr_type, int_type }, false),
+			llvm::Function::ExternalLinkage,
+			"return_array_items",
+			*module);
+		fn_channel_send_moved = llvm::Function::Create(
+			llvm::FunctionType::get(tp_bool, { obj_ptr, obj_ptr }, false),
+			llvm::Function::ExternalLinkage,
+			"channel_send_moved",
+			*module);
 	}
 
 	[[nodiscard]] Val compile(own<ast::Action>& action) {
@@ -798,6 +2699,20 @@ struct Generator : ast::ActionScanner {
 	void on_const_double(ast::ConstDouble& node) override { result->data = llvm::ConstantFP::get(double_type, node.value); }
 	void on_const_void(ast::ConstVoid&) override { result->data = llvm::UndefValue::get(void_type); }
 	void on_const_bool(ast::ConstBool& node) override { result->data = builder->getInt1(node.value); }
+	void on_const_string(ast::ConstString& node) override {
+		auto& literal = string_literals[node.value];
+		if (!literal) {
+			literal = new llvm::GlobalVariable(
+				*module,
+				classes[ast->string_cls].fields,
+				false,  // its counter changes on retain/release
+				llvm::GlobalValue::PrivateLinkage,
+				nullptr,
+				"str");
+		}
+		result->data = literal;
+		result->lifetime.emplace<Val::Temp>();  // immortal, so it is held elsewhere for any duration
+	}
 
 	void compile_fn_body(ast::MkLambda& node, llvm::Type* closure_ptr_type = nullptr) {
 		unordered_map<weak<ast::Var>, llvm::Value*> outer_locals;
@@ -991,7 +2906,7 @@ struct Generator : ast::ActionScanner {
 		node.error("delegates aren't supported yet");
 	}
 	void on_make_fn_ptr(ast::MakeFnPtr& node) {
-		result->data = functions[node.fn];
+		result->data = cast_to(functions[node.fn], to_llvm_type(*node.type()));  // sys_Array(T) calls have typed signatures
 	}
 	void on_call(ast::Call& node) override {
 		vector<llvm::Value*> params;
@@ -1048,17 +2963,42 @@ struct Generator : ast::ActionScanner {
 				to_dispose.push_back(comp_to_persistent(p));
 				params.push_back(cast_to(to_dispose.back().data, *pt++));
 			}
-			auto callee = compile(node.callee);
-			assert(get_if<Val::NonPtr>(&callee.lifetime));
-			if (!is_fn)
-				params.front() = builder->CreateExtractValue(callee.data, { 0 });
-			result->data = builder->CreateCall(
-				llvm::FunctionCallee(
-					function_type,
-					is_fn
-						? callee.data
-						: builder->CreateExtractValue(callee.data, { 1 })),
-				move(params));
+			auto as_fn_ref = dom::strict_cast<ast::MakeFnPtr>(node.callee);
+			auto intrinsic = as_fn_ref ? intrinsics.find(as_fn_ref->fn.pinned()) : intrinsics.end();
+			if (intrinsic != intrinsics.end()) {
+				auto format = byte_formats.find(intrinsic->first);
+				result->data = cast_to(
+					build_intrinsic(intrinsic->second, params, format == byte_formats.end() ? ByteFormat{ 1 } : format->second),
+					function_type->getReturnType());
+			} else if (as_fn_ref && as_fn_ref->fn.pinned() == array_set_at &&
+					dom::strict_cast<ast::TpClass>(node.params.back()->type()) &&
+					get_if<Val::Retained>(&to_dispose.back().lifetime)) {
+				// Fresh object is not shared with anyone, so it is stored as is instead of being copied.
+				result->data = build_intrinsic(Intrinsic::ArrayMoveAt, params);
+				to_dispose.back().lifetime.emplace<Val::NonPtr>();
+			} else if (as_fn_ref && as_fn_ref->fn.pinned() == channel_send &&
+					dom::strict_cast<ast::TpClass>(node.params.back()->type()) &&
+					get_if<Val::Retained>(&to_dispose.back().lifetime)) {
+				// Fresh object is not reachable from the sender, so the channel takes it over without a copy.
+				result->data = builder->CreateCall(fn_channel_send_moved, {
+					cast_to(params[0], obj_ptr),
+					cast_to(params[1], obj_ptr) });
+				to_dispose.back().lifetime.emplace<Val::NonPtr>();
+			} else if (as_fn_ref && as_fn_ref->fn.pinned() == array_sort) {
+				result->data = build_sort(node.params[1], params);
+			} else {
+				auto callee = compile(node.callee);
+				assert(get_if<Val::NonPtr>(&callee.lifetime));
+				if (!is_fn)
+					params.front() = builder->CreateExtractValue(callee.data, { 0 });
+				result->data = builder->CreateCall(
+					llvm::FunctionCallee(
+						function_type,
+						is_fn
+							? callee.data
+							: builder->CreateExtractValue(callee.data, { 1 })),
+					move(params));
+			}
 		}
 		if (is_ptr(node.type()))
 			result->lifetime.emplace<Val::Retained>();
@@ -1066,6 +3006,391 @@ struct Generator : ast::ActionScanner {
 			dispose_val(move(to_dispose.back()));
 	}
 
+	// Inline equivalents of Blob::get_size, get_at, set_at, get_i8_at, set_i8_at, get_ref_at, get_weak_at,
+	// String::get_at and ByteBuffer::get/set. String and ByteBuffer place their `size` and `data` as Container does,
+	// but their sizes are in bytes. ByteBuffer values are unaligned and get byte-swapped if stored big-endian.
+	// ArrayMoveAt is set_ref_at for a value that can be taken over without a copy, it consumes params[2].
+	// Blob setters take a cold path to Blob::unshare when the blob shares its items with a copy (`_capacity` < `_size`).
+	// Loads and stores are tagged with container TBAA so that size and data loads can be hoisted out of loops
+	// over items, after which the optimizer folds the bounds checks that the loop condition already implies.
+	llvm::Value* build_intrinsic(Intrinsic intrinsic, const vector<llvm::Value*>& params, ByteFormat format = { 1 }) {
+		auto container = ast->blob->base_class;
+		auto container_ptr = builder->CreateBitOrPointerCast(params[0], classes[container].fields->getPointerTo());
+		auto tagged = [](llvm::Instruction* inst, llvm::MDNode* tag) {
+			inst->setMetadata(llvm::LLVMContext::MD_tbaa, tag);
+			return inst;
+		};
+		auto size = tagged(
+			builder->CreateLoad(builder->CreateStructGEP(container_ptr, container->fields[0]->offset)),
+			tbaa_container_size);
+		if (intrinsic == Intrinsic::ContainerSize)
+			return size;
+		bool is_byte_access = intrinsic == Intrinsic::BlobGetByteAt || intrinsic == Intrinsic::BlobSetByteAt || intrinsic == Intrinsic::StringGetAt;
+		bool is_byte_buffer = intrinsic == Intrinsic::ByteBufferGet || intrinsic == Intrinsic::ByteBufferSet;
+		auto item_type = is_byte_access || is_byte_buffer ? llvm::Type::getInt8Ty(*context)
+			: intrinsic == Intrinsic::ArrayGetAt || intrinsic == Intrinsic::ArrayMoveAt ? obj_ptr
+			: intrinsic == Intrinsic::WeakArrayGetAt ? weak_block_ptr
+			: static_cast<llvm::Type*>(int_type);
+		auto index = params[1];
+		auto bb_in_bounds = llvm::BasicBlock::Create(*context, "", current_function);
+		auto bb_out_of_bounds = llvm::BasicBlock::Create(*context, "", current_function);
+		auto bb_join = llvm::BasicBlock::Create(*context, "", current_function);
+		auto in_bounds = builder->CreateICmpULT(
+			is_byte_access && intrinsic != Intrinsic::StringGetAt ? builder->CreateLShr(index, 3) : index,
+			size);
+		if (format.bytes > 1) {  // and the whole value fits
+			in_bounds = builder->CreateAnd(
+				in_bounds,
+				builder->CreateICmpULE(builder->getInt64(format.bytes), builder->CreateSub(size, index)));
+		}
+		builder->CreateCondBr(
+			in_bounds,
+			bb_in_bounds,
+			bb_out_of_bounds,
+			llvm::MDBuilder(*context).createBranchWeights(1000, 1));
+		builder->SetInsertPoint(bb_in_bounds);
+		llvm::Value* data = tagged(
+			builder->CreateLoad(builder->CreateBitOrPointerCast(
+				builder->CreateStructGEP(container_ptr, container->fields[1]->offset),
+				item_type->getPointerTo()->getPointerTo())),
+			tbaa_container_data);
+		if (intrinsic == Intrinsic::BlobSetAt || intrinsic == Intrinsic::BlobSetByteAt) {
+			auto capacity = tagged(
+				builder->CreateLoad(builder->CreateStructGEP(container_ptr, container->fields[2]->offset)),
+				tbaa_container_capacity);
+			auto bb_shared = llvm::BasicBlock::Create(*context, "", current_function);
+			auto bb_owned = llvm::BasicBlock::Create(*context, "", current_function);
+			auto bb_data_loaded = builder->GetInsertBlock();
+			builder->CreateCondBr(
+				builder->CreateICmpULT(capacity, size),
+				bb_shared,
+				bb_owned,
+				llvm::MDBuilder(*context).createBranchWeights(1, 1000));
+			builder->SetInsertPoint(bb_shared);
+			auto unshared = builder->CreateBitOrPointerCast(
+				builder->CreateCall(fn_unshare_blob, { cast_to(params[0], obj_ptr) }),
+				data->getType());
+			builder->CreateBr(bb_owned);
+			builder->SetInsertPoint(bb_owned);
+			auto data_phi = builder->CreatePHI(data->getType(), 2);
+			data_phi->addIncoming(data, bb_data_loaded);
+			data_phi->addIncoming(unshared, bb_shared);
+			data = data_phi;
+		}
+		llvm::Value* item_ptr = builder->CreateGEP(data, index);
+		llvm::Value* item = nullptr;
+		auto value_type = builder->getIntNTy(format.bytes * 8);
+		if (is_byte_buffer)
+			item_ptr = builder->CreateBitOrPointerCast(item_ptr, value_type->getPointerTo());
+		auto swap_bytes = [&](llvm::Value* val) {
+			return format.big_endian && format.bytes > 1
+				? builder->CreateUnaryIntrinsic(llvm::Intrinsic::bswap, val)
+				: val;
+		};
+		switch (intrinsic) {
+		case Intrinsic::ByteBufferSet: {
+			auto val = format.is_float
+				? builder->CreateBitCast(params[2], value_type)
+				: builder->CreateTrunc(params[2], value_type);
+			auto store = builder->CreateStore(swap_bytes(val), item_ptr);
+			store->setAlignment(llvm::Align(1));
+			tagged(store, tbaa_container_item);
+			break;
+		}
+		case Intrinsic::ByteBufferGet: {
+			auto load = builder->CreateLoad(item_ptr);
+			load->setAlignment(llvm::Align(1));
+			auto val = swap_bytes(tagged(load, tbaa_container_item));
+			item = format.is_float ? builder->CreateBitCast(val, double_type)
+				: format.bytes == 1 ? builder->CreateZExt(val, int_type)
+				: builder->CreateSExt(val, int_type);
+			break;
+		}
+		case Intrinsic::BlobSetAt:
+			tagged(builder->CreateStore(params[2], item_ptr), tbaa_container_item);
+			break;
+		case Intrinsic::BlobSetByteAt:
+			tagged(builder->CreateStore(builder->CreateTrunc(params[2], item_type), item_ptr), tbaa_container_item);
+			break;
+		case Intrinsic::ArrayMoveAt: {
+			auto prev = tagged(builder->CreateLoad(item_ptr), tbaa_container_item);
+			tagged(builder->CreateStore(cast_to(params[2], item_type), item_ptr), tbaa_container_item);
+			build_release(prev, false);
+			break;
+		}
+		case Intrinsic::BlobGetByteAt:
+		case Intrinsic::StringGetAt:
+			item = builder->CreateZExt(tagged(builder->CreateLoad(item_ptr), tbaa_container_item), int_type);
+			break;
+		default:
+			item = tagged(builder->CreateLoad(item_ptr), tbaa_container_item);
+			break;
+		}
+		auto bb_in_bounds_end = builder->GetInsertBlock();
+		builder->CreateBr(bb_join);
+		builder->SetInsertPoint(bb_out_of_bounds);
+		if (intrinsic == Intrinsic::ArrayMoveAt)
+			build_release(params[2], false);
+		builder->CreateBr(bb_join);
+		builder->SetInsertPoint(bb_join);
+		if (!item)
+			return llvm::UndefValue::get(void_type);
+		auto phi = builder->CreatePHI(item->getType(), 2);
+		phi->addIncoming(item, bb_in_bounds_end);
+		phi->addIncoming(llvm::Constant::getNullValue(item->getType()), bb_out_of_bounds);
+		if (intrinsic == Intrinsic::ArrayGetAt || intrinsic == Intrinsic::WeakArrayGetAt)
+			build_retain(phi, intrinsic == Intrinsic::WeakArrayGetAt);
+		return phi;
+	}
+
+	// sys_Array_sort(array, comparator) as an introsort over raw item pointers, with no retain/release of items.
+	// The comparator of a literal lambda is called directly and gets inlined, see build_sort_fn.
+	// If it can't change containers, the array items are sorted in place. Otherwise they are taken out of
+	// the array for the duration of the sort, so the comparator can neither free nor move them.
+	llvm::Value* build_sort(own<ast::Action>& comparator, const vector<llvm::Value*>& params) {
+		auto lambda = params[1];
+		auto literal = dom::strict_cast<ast::MkLambda>(comparator);
+		auto literal_fn = literal ? compiled_functions[literal] : nullptr;
+		bool in_place = literal && !may_change_containers(comparator);
+		auto cmp_type = llvm::cast<llvm::FunctionType>(
+			llvm::cast<llvm::StructType>(lambda->getType())->getElementType(1)->getPointerElementType());
+		auto items_type = tp_int_ptr->getPointerTo();
+		auto size = build_intrinsic(Intrinsic::ContainerSize, { params[0] });
+		llvm::Value* items = nullptr;
+		if (in_place) {
+			auto container = ast->blob->base_class;
+			items = builder->CreateLoad(builder->CreateBitOrPointerCast(
+				builder->CreateStructGEP(
+					builder->CreateBitOrPointerCast(params[0], classes[container].fields->getPointerTo()),
+					container->fields[1]->offset),
+				items_type->getPointerTo()));
+		} else {
+			items = builder->CreateBitOrPointerCast(
+				builder->CreateCall(fn_take_array_items, { cast_to(params[0], obj_ptr) }),
+				items_type);
+		}
+		auto depth_limit = builder->CreateShl(  // 2 * log2(size)
+			builder->CreateSub(
+				builder->getInt64(63),
+				builder->CreateIntrinsic(llvm::Intrinsic::ctlz, { int_type }, { builder->CreateOr(size, 1), builder->getFalse() })),
+			1);
+		builder->CreateCall(build_sort_fn(cmp_type, literal_fn), {
+			builder->CreateExtractValue(lambda, { 0 }),
+			builder->CreateExtractValue(lambda, { 1 }),
+			items,
+			builder->getInt64(0),
+			size,
+			depth_limit });
+		if (!in_place) {
+			builder->CreateCall(fn_return_array_items, {
+				cast_to(params[0], obj_ptr),
+				builder->CreateBitOrPointerCast(items, void_ptr_type),
+				size });
+		}
+		return llvm::UndefValue::get(void_type);
+	}
+	// Builds `void (closure, comparator, items, begin, end, depth_limit)`: quicksort with median of three and
+	// Hoare partition that recurses into the smaller part, falls back to heapsort when out of depth, and
+	// finishes ranges of up to 16 items with insertion sort. Index checks in inner loops keep it in bounds
+	// even if the comparator is inconsistent.
+	llvm::Function* build_sort_fn(llvm::FunctionType* cmp_type, llvm::Function* literal_cmp) {
+		auto items_type = tp_int_ptr->getPointerTo();
+		auto cmp_ptr_type = cmp_type->getPointerTo();
+		auto sort_fn = llvm::Function::Create(
+			llvm::FunctionType::get(void_type, { void_ptr_type, cmp_ptr_type, items_type, int_type, int_type, int_type }, false),
+			llvm::Function::InternalLinkage,
+			"sort",
+			module.get());
+		auto sift_fn = llvm::Function::Create(  // (closure, comparator, items, root, end), heap of items [0, end)
+			llvm::FunctionType::get(void_type, { void_ptr_type, cmp_ptr_type, items_type, int_type, int_type }, false),
+			llvm::Function::InternalLinkage,
+			"sift_down",
+			module.get());
+		if (literal_cmp)
+			literal_cmp->addFnAttr(llvm::Attribute::AlwaysInline);
+		struct FnBuilder {
+			Generator& gen;
+			llvm::Function* fn;
+			llvm::FunctionType* cmp_type;
+			llvm::Value* cmp;
+			llvm::IRBuilder<> b;
+			llvm::Value* closure;
+			llvm::Value* items;
+			FnBuilder(Generator& gen, llvm::Function* fn, llvm::FunctionType* cmp_type, llvm::Function* literal_cmp)
+				: gen(gen)
+				, fn(fn)
+				, cmp_type(cmp_type)
+				, b(llvm::BasicBlock::Create(*gen.context, "", fn))
+				, closure(fn->getArg(0))
+				, items(fn->getArg(2)) {
+				cmp = literal_cmp ? static_cast<llvm::Value*>(literal_cmp) : fn->getArg(1);
+			}
+			llvm::BasicBlock* block() { return llvm::BasicBlock::Create(*gen.context, "", fn); }
+			llvm::AllocaInst* var(llvm::Value* initial) {  // placed in the entry block to be promoted to a register
+				auto& entry = fn->getEntryBlock();
+				auto r = llvm::IRBuilder<>(&entry, entry.begin()).CreateAlloca(gen.int_type);
+				b.CreateStore(initial, r);
+				return r;
+			}
+			llvm::Value* get(llvm::Value* var) { return b.CreateLoad(var); }
+			llvm::Value* at(llvm::Value* index) { return b.CreateLoad(b.CreateGEP(items, index)); }
+			void set_at(llvm::Value* index, llvm::Value* item) { b.CreateStore(item, b.CreateGEP(items, index)); }
+			void swap(llvm::Value* i, llvm::Value* j) {
+				auto item_i = at(i);
+				auto item_j = at(j);
+				set_at(i, item_j);
+				set_at(j, item_i);
+			}
+			llvm::Value* less(llvm::Value* a, llvm::Value* c) {
+				return b.CreateCall(llvm::FunctionCallee(cmp_type, cmp), { closure, a, c });
+			}
+			llvm::Value* add(llvm::Value* a, int64_t c) { return b.CreateAdd(a, b.getInt64(c)); }
+			llvm::Value* both(llvm::Value* cond, const std::function<llvm::Value*()>& then) {  // `then` runs only if `cond`
+				auto bb_cond = b.GetInsertBlock();
+				auto bb_then = block();
+				auto bb_end = block();
+				b.CreateCondBr(cond, bb_then, bb_end);
+				b.SetInsertPoint(bb_then);
+				auto then_val = then();
+				auto bb_then_end = b.GetInsertBlock();
+				b.CreateBr(bb_end);
+				b.SetInsertPoint(bb_end);
+				auto r = b.CreatePHI(b.getInt1Ty(), 2);
+				r->addIncoming(b.getFalse(), bb_cond);
+				r->addIncoming(then_val, bb_then_end);
+				return r;
+			}
+			void if_then(llvm::Value* cond, const std::function<void()>& then) {
+				auto bb_then = block();
+				auto bb_end = block();
+				b.CreateCondBr(cond, bb_then, bb_end);
+				b.SetInsertPoint(bb_then);
+				then();
+				b.CreateBr(bb_end);
+				b.SetInsertPoint(bb_end);
+			}
+			// Runs `body` while `cond` is true, both get the block to break to.
+			void loop(const std::function<llvm::Value*()>& cond, const std::function<void(llvm::BasicBlock*)>& body) {
+				auto bb_head = block();
+				auto bb_body = block();
+				auto bb_end = block();
+				b.CreateBr(bb_head);
+				b.SetInsertPoint(bb_head);
+				b.CreateCondBr(cond(), bb_body, bb_end);
+				b.SetInsertPoint(bb_body);
+				body(bb_end);
+				b.CreateBr(bb_head);
+				b.SetInsertPoint(bb_end);
+			}
+			void break_if(llvm::Value* cond, llvm::BasicBlock* bb_end) {
+				auto bb_next = block();
+				b.CreateCondBr(cond, bb_end, bb_next);
+				b.SetInsertPoint(bb_next);
+			}
+		};
+		{
+			FnBuilder f(*this, sift_fn, cmp_type, literal_cmp);
+			auto& b = f.b;
+			auto root = f.var(sift_fn->getArg(3));
+			auto end = sift_fn->getArg(4);
+			f.loop([&] { return b.getTrue(); }, [&](llvm::BasicBlock* bb_end) {
+				auto child = f.var(f.add(b.CreateShl(f.get(root), 1), 1));
+				f.break_if(b.CreateICmpSGE(f.get(child), end), bb_end);
+				auto right = f.add(f.get(child), 1);
+				f.if_then(b.CreateICmpSLT(right, end), [&] {
+					f.if_then(f.less(f.at(f.get(child)), f.at(right)), [&] { b.CreateStore(right, child); });
+				});
+				f.break_if(b.CreateNot(f.less(f.at(f.get(root)), f.at(f.get(child)))), bb_end);
+				f.swap(f.get(root), f.get(child));
+				b.CreateStore(f.get(child), root);
+			});
+			b.CreateRetVoid();
+		}
+		FnBuilder f(*this, sort_fn, cmp_type, literal_cmp);
+		auto& b = f.b;
+		auto lo = f.var(sort_fn->getArg(3));
+		auto hi = f.var(sort_fn->getArg(4));
+		auto depth = f.var(sort_fn->getArg(5));
+		auto bb_ret = f.block();
+		f.loop([&] { return b.CreateICmpSGT(b.CreateSub(f.get(hi), f.get(lo)), b.getInt64(16)); }, [&](llvm::BasicBlock*) {
+			f.if_then(b.CreateICmpEQ(f.get(depth), b.getInt64(0)), [&] {  // heapsort [lo, hi)
+				auto heap = b.CreateGEP(f.items, f.get(lo));
+				auto size = b.CreateSub(f.get(hi), f.get(lo));
+				auto i = f.var(b.CreateAShr(size, 1));
+				f.loop([&] { return b.CreateICmpSGT(f.get(i), b.getInt64(0)); }, [&](llvm::BasicBlock*) {
+					b.CreateStore(f.add(f.get(i), -1), i);
+					b.CreateCall(sift_fn, { f.closure, sort_fn->getArg(1), heap, f.get(i), size });
+				});
+				b.CreateStore(size, i);
+				f.loop([&] { return b.CreateICmpSGT(f.get(i), b.getInt64(1)); }, [&](llvm::BasicBlock*) {
+					b.CreateStore(f.add(f.get(i), -1), i);
+					f.swap(f.get(lo), b.CreateAdd(f.get(lo), f.get(i)));
+					b.CreateCall(sift_fn, { f.closure, sort_fn->getArg(1), heap, b.getInt64(0), f.get(i) });
+				});
+				b.CreateBr(bb_ret);
+				b.SetInsertPoint(f.block());  // unreachable continuation
+			});
+			b.CreateStore(f.add(f.get(depth), -1), depth);
+			auto first = f.get(lo);
+			auto last = f.add(f.get(hi), -1);
+			auto mid = b.CreateAdd(first, b.CreateAShr(b.CreateSub(last, first), 1));
+			f.if_then(f.less(f.at(mid), f.at(first)), [&] { f.swap(mid, first); });
+			f.if_then(f.less(f.at(last), f.at(mid)), [&] {
+				f.swap(last, mid);
+				f.if_then(f.less(f.at(mid), f.at(first)), [&] { f.swap(mid, first); });
+			});
+			auto pivot = f.at(mid);
+			auto i = f.var(f.add(first, -1));
+			auto j = f.var(f.add(last, 1));
+			f.loop([&] { return b.getTrue(); }, [&](llvm::BasicBlock* bb_end) {
+				b.CreateStore(f.add(f.get(i), 1), i);
+				f.loop(
+					[&] { return f.both(b.CreateICmpSLT(f.get(i), last), [&] { return f.less(f.at(f.get(i)), pivot); }); },
+					[&](llvm::BasicBlock*) { b.CreateStore(f.add(f.get(i), 1), i); });
+				b.CreateStore(f.add(f.get(j), -1), j);
+				f.loop(
+					[&] { return f.both(b.CreateICmpSGT(f.get(j), first), [&] { return f.less(pivot, f.at(f.get(j))); }); },
+					[&](llvm::BasicBlock*) { b.CreateStore(f.add(f.get(j), -1), j); });
+				f.break_if(b.CreateICmpSGE(f.get(i), f.get(j)), bb_end);
+				f.swap(f.get(i), f.get(j));
+			});
+			auto split = f.add(f.get(j), 1);  // [lo, split) <= pivot <= [split, hi)
+			auto bb_left_smaller = f.block();
+			auto bb_right_smaller = f.block();
+			auto bb_next = f.block();
+			b.CreateCondBr(
+				b.CreateICmpSLT(b.CreateSub(split, f.get(lo)), b.CreateSub(f.get(hi), split)),
+				bb_left_smaller,
+				bb_right_smaller);
+			b.SetInsertPoint(bb_left_smaller);
+			b.CreateCall(sort_fn, { f.closure, sort_fn->getArg(1), f.items, f.get(lo), split, f.get(depth) });
+			b.CreateStore(split, lo);
+			b.CreateBr(bb_next);
+			b.SetInsertPoint(bb_right_smaller);
+			b.CreateCall(sort_fn, { f.closure, sort_fn->getArg(1), f.items, split, f.get(hi), f.get(depth) });
+			b.CreateStore(split, hi);
+			b.CreateBr(bb_next);
+			b.SetInsertPoint(bb_next);
+		});
+		auto i = f.var(f.add(f.get(lo), 1));  // insertion sort [lo, hi)
+		f.loop([&] { return b.CreateICmpSLT(f.get(i), f.get(hi)); }, [&](llvm::BasicBlock*) {
+			auto item = f.at(f.get(i));
+			auto j = f.var(f.get(i));
+			f.loop(
+				[&] { return f.both(b.CreateICmpSGT(f.get(j), f.get(lo)), [&] { return f.less(item, f.at(f.add(f.get(j), -1))); }); },
+				[&](llvm::BasicBlock*) {
+					f.set_at(f.get(j), f.at(f.add(f.get(j), -1)));
+					b.CreateStore(f.add(f.get(j), -1), j);
+				});
+			f.set_at(f.get(j), item);
+			b.CreateStore(f.add(f.get(i), 1), i);
+		});
+		b.CreateBr(bb_ret);
+		b.SetInsertPoint(bb_ret);
+		b.CreateRetVoid();
+		return sort_fn;
+	}
+
 	llvm::Value* get_data_ref(const weak<ast::Var>& var) {
 		auto it = locals.find(var);
 		if (it != locals.end())
@@ -1724,6 +4049,107 @@ struct Generator : ast::ActionScanner {
 		result->data = extract_opt_val(result->data, r_type);
 		result->type = node.type();
 	}
+	// True if `action` can run code beyond inline container reads or drop object references.
+	// Either can modify or free items of a container that `each` walks.
+	bool may_change_containers(own<ast::Action>& action) {
+		struct Finder : ast::ActionScanner {
+			Generator& gen;
+			bool found = false;
+			Finder(Generator& gen) : gen(gen) {}
+			void on_call(ast::Call& node) override {
+				auto as_fn_ref = dom::strict_cast<ast::MakeFnPtr>(node.callee);
+				auto intrinsic = as_fn_ref ? gen.intrinsics.find(as_fn_ref->fn.pinned()) : gen.intrinsics.end();
+				if (intrinsic == gen.intrinsics.end() ||
+					intrinsic->second == Intrinsic::BlobSetAt ||
+					intrinsic->second == Intrinsic::BlobSetByteAt)
+					found = true;
+				ActionScanner::on_call(node);
+			}
+			void on_set(ast::Set& node) override {
+				if (gen.is_ptr(node.var->type))  // releases the previous value
+					found = true;
+				ActionScanner::on_set(node);
+			}
+			void on_set_field(ast::SetField& node) override { found = true; }
+			void on_mk_instance(ast::MkInstance& node) override { found = true; }
+			void on_copy(ast::CopyOp& node) override { found = true; }
+		} finder(*this);
+		finder.fix(action);
+		return finder.found;
+	}
+	// Walks items in place with the index as the only loop state.
+	// If the body can't change the container, its size and data are loaded once, and items are lent
+	// to the body without retain/release. Otherwise both are reloaded on each step and items are retained.
+	void on_each(ast::Each& node) override {
+		auto cls = ast->extract_class(node.p[0]->type());
+		auto block = dom::strict_cast<ast::Block>(node.p[1]);
+		auto item_type = block->names.front()->type;
+		bool is_pinned = !may_change_containers(node.p[1]);
+		auto container = comp_to_persistent(node.p[0]);
+		auto container_cls = ast->blob->base_class;
+		auto container_ptr = builder->CreateBitOrPointerCast(container.data, classes[container_cls].fields->getPointerTo());
+		auto slot_type = cls == ast->string_cls ? llvm::Type::getInt8Ty(*context)
+			: ast->array_item(cls) ? obj_ptr
+			: cls == ast->weak_array ? weak_block_ptr
+			: static_cast<llvm::Type*>(int_type);
+		auto tagged = [](llvm::Instruction* inst, llvm::MDNode* tag) {
+			inst->setMetadata(llvm::LLVMContext::MD_tbaa, tag);
+			return inst;
+		};
+		auto load_size = [&] {
+			return tagged(
+				builder->CreateLoad(builder->CreateStructGEP(container_ptr, container_cls->fields[0]->offset)),
+				tbaa_container_size);
+		};
+		auto load_data = [&] {
+			return tagged(
+				builder->CreateLoad(builder->CreateBitOrPointerCast(
+					builder->CreateStructGEP(container_ptr, container_cls->fields[1]->offset),
+					slot_type->getPointerTo()->getPointerTo())),
+				tbaa_container_data);
+		};
+		llvm::Value* size = is_pinned ? load_size() : nullptr;
+		llvm::Value* data = is_pinned ? load_data() : nullptr;
+		auto entry_bb = builder->GetInsertBlock();
+		auto header_bb = llvm::BasicBlock::Create(*context, "", current_function);
+		auto body_bb = llvm::BasicBlock::Create(*context, "", current_function);
+		auto after_bb = llvm::BasicBlock::Create(*context, "", current_function);
+		builder->CreateBr(header_bb);
+		builder->SetInsertPoint(header_bb);
+		auto index = builder->CreatePHI(int_type, 2);
+		index->addIncoming(builder->getInt64(0), entry_bb);
+		builder->CreateCondBr(
+			builder->CreateICmpULT(index, is_pinned ? size : load_size()),
+			body_bb,
+			after_bb,
+			llvm::MDBuilder(*context).createBranchWeights(1000, 1));
+		builder->SetInsertPoint(body_bb);
+		llvm::Value* item = tagged(
+			builder->CreateLoad(builder->CreateGEP(is_pinned ? data : load_data(), index)),
+			tbaa_container_item);
+		if (cls == ast->string_cls)
+			item = builder->CreateZExt(item, int_type);
+		Val item_val{ item_type, cast_to(item, to_llvm_type(*item_type)) };
+		if (is_ptr(item_type)) {
+			if (is_pinned) {
+				item_val.lifetime = Val::Temp{};
+			} else {
+				build_retain(item_val.data, is_weak(item_type));
+				item_val.lifetime = Val::Retained{};
+			}
+		}
+		auto body_val = handle_block(*block, move(item_val));
+		if (get_if<Val::Retained>(&result->lifetime)) {  // handle_block passed the item lock to the body result
+			body_val.lifetime.emplace<Val::Retained>();
+			result->lifetime.emplace<Val::NonPtr>();
+		}
+		dispose_val(move(body_val));
+		index->addIncoming(builder->CreateAdd(index, builder->getInt64(1)), builder->GetInsertBlock());
+		builder->CreateBr(header_bb);
+		builder->SetInsertPoint(after_bb);
+		dispose_val(move(container));
+		result->data = llvm::UndefValue::get(void_type);
+	}
 	void on_copy(ast::CopyOp& node) override {
 		auto src = compile(node.p);
 		result->data = builder->CreateBitOrPointerCast(
@@ -1976,7 +4402,19 @@ struct Generator : ast::ActionScanner {
 	llvm::orc::ThreadSafeModule build() {
 		make_fn_retain();
 		make_fn_retain_weak();
-		std::unordered_set<pin<ast::TpClass>> special_copy_and_dispose = { ast->blob->base_class, ast->blob, ast->own_array, ast->weak_array };
+		std::unordered_set<pin<ast::TpClass>> special_copy_and_dispose = {
+			ast->blob->base_class, ast->blob, ast->bitset, ast->weak_array };
+		for (auto& a : ast->own_arrays)
+			special_copy_and_dispose.insert(a.pinned());
+		for (auto& m : ast->maps)
+			special_copy_and_dispose.insert(m.pinned());
+		for (auto& d : ast->deques)
+			special_copy_and_dispose.insert(d.pinned());
+		special_copy_and_dispose.insert(ast->string_cls.pinned());
+		special_copy_and_dispose.insert(ast->file_cls.pinned());
+		special_copy_and_dispose.insert(ast->byte_buffer.pinned());
+		special_copy_and_dispose.insert(ast->rope_cls.pinned());
+		special_copy_and_dispose.insert(ast->channel_cls.pinned());
 		dispatcher_fn_type = llvm::FunctionType::get(void_ptr_type, { int_type }, false);
 		auto dispos_fn_type = llvm::FunctionType::get(void_type, { obj_ptr }, false);
 		auto copier_fn_type = llvm::FunctionType::get(
@@ -1986,13 +4424,17 @@ struct Generator : ast::ActionScanner {
 				obj_ptr  // src
 			},
 			false);  // varargs
+		auto visitor_fn_type = llvm::FunctionType::get(void_type, { obj_ptr }, false);
 		obj_vmt_type = llvm::StructType::get(
 			*context,
 			{
 				copier_fn_type->getPointerTo(),
 				dispos_fn_type->getPointerTo(),
 				int_type,  // instance alloc size
-				int_type   // obj vmt size (used in casts)
+				int_type,  // obj vmt size (used in casts)
+				visitor_fn_type->getPointerTo(),
+				fn_allocate_raw->getType(),
+				fn_free_raw->getType()
 			});
 		auto initializer_fn_type = llvm::FunctionType::get(void_type, { obj_ptr }, false);
 		// Make LLVM types for classes
@@ -2078,13 +4520,56 @@ struct Generator : ast::ActionScanner {
 					: llvm::Function::InternalLinkage,
 				std::to_string(fn->name.pinned()), module.get())});
 		}
+		auto add_intrinsic = [&](pin<ast::TpClass> cls, const char* name, Intrinsic intrinsic) {
+			if (auto fn_name = cls->name->peek(name)) {
+				if (auto fn = ast->functions_by_names[fn_name].pinned())
+					intrinsics[fn] = intrinsic;
+			}
+		};
+		add_intrinsic(ast->blob->base_class, "size", Intrinsic::ContainerSize);
+		add_intrinsic(ast->blob, "getAt", Intrinsic::BlobGetAt);
+		add_intrinsic(ast->blob, "setAt", Intrinsic::BlobSetAt);
+		add_intrinsic(ast->blob, "getByteAt", Intrinsic::BlobGetByteAt);
+		add_intrinsic(ast->blob, "setByteAt", Intrinsic::BlobSetByteAt);
+		add_intrinsic(ast->own_array, "getAt", Intrinsic::ArrayGetAt);
+		add_intrinsic(ast->weak_array, "getAt", Intrinsic::WeakArrayGetAt);
+		add_intrinsic(ast->string_cls, "size", Intrinsic::ContainerSize);
+		add_intrinsic(ast->string_cls, "getAt", Intrinsic::StringGetAt);
+		add_intrinsic(ast->byte_buffer, "size", Intrinsic::ContainerSize);
+		add_intrinsic(ast->byte_buffer, "getAt", Intrinsic::ByteBufferGet);
+		add_intrinsic(ast->byte_buffer, "setAt", Intrinsic::ByteBufferSet);
+		for (auto& [type, format] : std::initializer_list<pair<const char*, ByteFormat>>{
+				{ "I16", { 2 } },
+				{ "I32", { 4 } },
+				{ "I64", { 8 } },
+				{ "F64", { 8, false, true } },
+				{ "I16Be", { 2, true } },
+				{ "I32Be", { 4, true } },
+				{ "I64Be", { 8, true } },
+				{ "F64Be", { 8, true, true } } }) {
+			for (auto is_set : { false, true }) {
+				add_intrinsic(ast->byte_buffer, (string(is_set ? "set" : "get") + type).c_str(),
+					is_set ? Intrinsic::ByteBufferSet : Intrinsic::ByteBufferGet);
+				if (auto fn_name = ast->byte_buffer->name->peek(string(is_set ? "set" : "get") + type))
+					byte_formats[ast->functions_by_names[fn_name].pinned()] = format;
+			}
+		}
+		if (auto fn_name = ast->own_array->name->peek("setAt"))
+			array_set_at = ast->functions_by_names[fn_name].pinned();
+		if (auto fn_name = ast->own_array->name->peek("sort"))
+			array_sort = ast->functions_by_names[fn_name].pinned();
+		if (auto fn_name = ast->channel_cls->name->peek("send"))
+			channel_send = ast->functions_by_names[fn_name].pinned();
 		// Build class contents - initializer, dispatcher, disposer, copier, methods.
 		for (auto& cls : ast->classes) {
 			if (cls->is_interface)
 				continue;
 			auto& info = classes[cls];
 			ClassInfo* base_info = cls->base_class ? &classes[cls->base_class] : nullptr;
-			info.dispose = llvm::Function::Create(dispos_fn_type, llvm::Function::InternalLinkage,
+			ClassInfo* array_info = cls != ast->own_array && ast->array_item(cls)  // sys_Array(T) disposes, copies and visits as sys_Array
+				? &classes[ast->own_array]
+				: nullptr;
+			info.dispose = array_info ? array_info->dispose : llvm::Function::Create(dispos_fn_type, llvm::Function::InternalLinkage,
 				std::to_string(cls->name.pinned()) + "!dtor", module.get());
 			info.dispatcher = llvm::Function::Create(dispatcher_fn_type, llvm::Function::InternalLinkage,
 				std::to_string(cls->name.pinned()) + "!disp", module.get());
@@ -2101,9 +4586,34 @@ struct Generator : ast::ActionScanner {
 					builder.CreateStructGEP(result, field->offset));
 			}
 			builder.CreateRetVoid();
+			// Allocator
+			auto find_manual_fn = [&](const char* suffix) -> pin<ast::Function> {
+				if (auto name = cls->name->peek(suffix)) {
+					if (auto fn = ast->functions_by_names.find(name); fn != ast->functions_by_names.end())
+						return fn->second.pinned();
+				}
+				return nullptr;
+			};
+			info.allocate = fn_allocate_raw;
+			info.free = fn_free_raw;
+			if (auto manual_allocate = find_manual_fn("allocate"), manual_free = find_manual_fn("free"); manual_allocate || manual_free) {
+				if (!manual_allocate || !manual_free)
+					(manual_allocate ? manual_allocate : manual_free)->error("class ", cls->name.pinned(), " needs both allocate and free functions");
+				info.allocate = functions[manual_allocate];
+				info.free = functions[manual_free];
+				if (info.allocate->getType() != fn_allocate_raw->getType())
+					manual_allocate->error("expected fn(int size) int");
+				if (info.free->getType() != fn_free_raw->getType())
+					manual_free->error("expected fn(int ptr)");
+			}
 			// Constructor
 			builder.SetInsertPoint(llvm::BasicBlock::Create(*context, "", info.constructor));
-			result = builder.CreateCall(fn_allocate, { builder.getInt64(layout.getTypeAllocSize(info.fields)) });
+			auto instance_size = builder.getInt64(layout.getTypeAllocSize(info.fields));
+			result = info.allocate == fn_allocate_raw
+				? builder.CreateCall(fn_allocate, { instance_size })
+				: builder.CreateCall(fn_init_instance, {
+					builder.CreateIntToPtr(builder.CreateCall(info.allocate, { instance_size }), obj_ptr),
+					instance_size });
 			builder.CreateCall(info.initializer, { result });
 			auto typed_result = builder.CreateBitOrPointerCast(result, info.fields->getPointerTo());
 			builder.CreateStore(info.dispatcher, builder.CreateStructGEP(typed_result, 0));
@@ -2131,7 +4641,7 @@ struct Generator : ast::ActionScanner {
 				builder.CreateRetVoid();
 			}
 			// Copier
-			info.copier = llvm::Function::Create(copier_fn_type, llvm::Function::InternalLinkage,
+			info.copier = array_info ? array_info->copier : llvm::Function::Create(copier_fn_type, llvm::Function::InternalLinkage,
 				std::to_string(cls->name.pinned()) + "!copy", module.get());
 			if (special_copy_and_dispose.count(cls) == 0) {
 				builder.SetInsertPoint(llvm::BasicBlock::Create(*context, "", info.copier));
@@ -2173,6 +4683,26 @@ struct Generator : ast::ActionScanner {
 				}
 				builder.CreateRetVoid();
 			}
+			// Visitor
+			info.visitor = array_info ? array_info->visitor : llvm::Function::Create(visitor_fn_type, llvm::Function::InternalLinkage,
+				std::to_string(cls->name.pinned()) + "!visit", module.get());
+			if (special_copy_and_dispose.count(cls) == 0) {
+				builder.SetInsertPoint(llvm::BasicBlock::Create(*context, "", info.visitor));
+				if (base_info)
+					builder.CreateCall(base_info->visitor, { info.visitor->getArg(0) });
+				auto self = builder.CreateBitOrPointerCast(info.visitor->getArg(0), info.fields->getPointerTo());
+				for (auto& f : cls->fields) {
+					auto type = f->initializer->type();
+					if (is_weak(type)) {
+						builder.CreateCall(fn_visit_weak_field, {
+							cast_to(builder.CreateStructGEP(self, f->offset), weak_block_ptr->getPointerTo()) });
+					} else if (is_ptr(type)) {
+						builder.CreateCall(fn_visit_object_field, {
+							cast_to(builder.CreateStructGEP(self, f->offset), obj_ptr->getPointerTo()) });
+					}
+				}
+				builder.CreateRetVoid();
+			}
 			// Class methods
 			info.vmt_fields.push_back(info.dispatcher);  // class id for casts
 			for (auto& m : cls->new_methods) {
@@ -2197,7 +4727,10 @@ struct Generator : ast::ActionScanner {
 				info.copier,
 				info.dispose,
 				builder.getInt64(layout.getTypeStoreSize(info.fields)),
-				builder.getInt64(info.vmt_size) }));
+				builder.getInt64(info.vmt_size),
+				info.visitor,
+				info.allocate,
+				info.free }));
 			info.dispatcher->setPrefixData(llvm::ConstantStruct::get(info.vmt, move(info.vmt_fields)));
 			size_t interfaces_count = cls->interface_vmts.size();
 			// Interface methods
@@ -2232,6 +4765,25 @@ struct Generator : ast::ActionScanner {
 								builder.getInt64(0xffff))
 						})));
 		}
+		// Class table, used to bind heap images to dispatchers.
+		auto class_entry_type = llvm::StructType::get(*context, { void_ptr_type, void_ptr_type });  // {name, dispatcher}
+		vector<llvm::Constant*> class_table;
+		for (auto& cls : ast->classes) {
+			if (!cls->is_interface) {
+				class_table.push_back(llvm::ConstantStruct::get(class_entry_type, {
+					make_const_string(std::to_string(cls->name.pinned())),
+					llvm::ConstantExpr::getBitCast(classes[cls].dispatcher, void_ptr_type) }));
+			}
+		}
+		class_table.push_back(llvm::Constant::getNullValue(class_entry_type));
+		auto class_table_type = llvm::ArrayType::get(class_entry_type, class_table.size());
+		new llvm::GlobalVariable(
+			*module,
+			class_table_type,
+			true,  // constant
+			llvm::GlobalValue::ExternalLinkage,
+			llvm::ConstantArray::get(class_table_type, move(class_table)),
+			"!classes");
 		// Compile standalone functions.
 		for (auto& fn : ast->functions) {
 			if (!fn->is_platform) {
@@ -2244,9 +4796,34 @@ struct Generator : ast::ActionScanner {
 			llvm::Function::ExternalLinkage,
 			"main", module.get());
 		compile_fn_body(*ast->entry_point);
+		build_string_literals();
 		return llvm::orc::ThreadSafeModule(std::move(module), std::move(context));
 	}
 
+	// Literal bytes are padded to whole words, as heap images store string buffers by words.
+	void build_string_literals() {
+		auto& info = classes[ast->string_cls];
+		for (auto& literal : string_literals) {
+			auto bytes = literal.first;
+			bytes.resize(std::max<size_t>(sizeof(int64_t), (bytes.size() + sizeof(int64_t) - 1) & ~(sizeof(int64_t) - 1)));
+			auto data = new llvm::GlobalVariable(
+				*module,
+				llvm::ArrayType::get(llvm::Type::getInt8Ty(*context), bytes.size()),
+				true,
+				llvm::GlobalValue::PrivateLinkage,
+				llvm::ConstantDataArray::getString(*context, bytes, false));
+			data->setAlignment(llvm::Align(sizeof(int64_t)));
+			vector<llvm::Constant*> fields{
+				info.dispatcher,
+				llvm::ConstantInt::get(int_type, Object::CTR_IMMORTAL),
+				llvm::ConstantInt::get(int_type, literal.first.size()),
+				llvm::ConstantExpr::getPtrToInt(data, int_type) };
+			while (fields.size() < info.fields->getNumElements())
+				fields.push_back(llvm::ConstantInt::get(int_type, 0));
+			literal.second->setInitializer(llvm::ConstantStruct::get(info.fields, move(fields)));
+		}
+	}
+
 	llvm::Constant* make_const_array(string name, vector<llvm::Constant*> content) {
 		auto type = llvm::ArrayType::get(void_ptr_type, content.size());
 		module->getOrInsertGlobal(name, type);
@@ -2256,6 +4833,13 @@ struct Generator : ast::ActionScanner {
 		result->setLinkage(llvm::GlobalValue::InternalLinkage);
 		return result;
 	}
+
+	llvm::Constant* make_const_string(const string& content) {
+		auto str = llvm::ConstantDataArray::getString(*context, content);
+		auto result = new llvm::GlobalVariable(*module, str->getType(), true, llvm::GlobalValue::PrivateLinkage, str);
+		result->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+		return llvm::ConstantExpr::getBitCast(result, void_ptr_type);
+	}
 };
 
 llvm::orc::ThreadSafeModule generate_code(ltm::pin<ast::Ast> ast) {
@@ -2263,15 +4847,56 @@ llvm::orc::ThreadSafeModule generate_code(ltm::pin<ast::Ast> ast) {
 	return gen.build();
 }
 
+// Cleans up generated code, hoists container size and data loads out of loops
+// and merges bounds checks that the optimizer can prove redundant.
+// Loops over pinned container items (see Generator::on_each) get vectorized for the host CPU.
+static void optimize(llvm::Module& module) {
+	llvm::ExitOnError check;
+	auto target_machine = check(check(llvm::orc::JITTargetMachineBuilder::detectHost()).createTargetMachine());
+	module.setDataLayout(target_machine->createDataLayout());
+	llvm::legacy::PassManager module_passes;
+	module_passes.add(llvm::createAlwaysInlinerLegacyPass());  // sort comparators, see Generator::build_sort
+	module_passes.run(module);
+	llvm::legacy::FunctionPassManager passes(&module);
+	passes.add(llvm::createTargetTransformInfoWrapperPass(target_machine->getTargetIRAnalysis()));
+	passes.add(llvm::createTypeBasedAAWrapperPass());
+	passes.add(llvm::createBasicAAWrapperPass());
+	passes.add(llvm::createPromoteMemoryToRegisterPass());
+	passes.add(llvm::createInstructionCombiningPass());
+	passes.add(llvm::createCFGSimplificationPass());
+	passes.add(llvm::createEarlyCSEPass());
+	passes.add(llvm::createJumpThreadingPass());
+	passes.add(llvm::createInstructionCombiningPass());
+	passes.add(llvm::createCFGSimplificationPass());
+	passes.add(llvm::createLoopRotatePass());
+	passes.add(llvm::createLICMPass());
+	passes.add(llvm::createIndVarSimplifyPass());
+	passes.add(llvm::createCorrelatedValuePropagationPass());
+	passes.add(llvm::createInstructionCombiningPass());
+	passes.add(llvm::createCFGSimplificationPass());
+	passes.add(llvm::createLICMPass());
+	passes.add(llvm::createGVNPass());
+	passes.add(llvm::createInstructionCombiningPass());
+	passes.add(llvm::createCFGSimplificationPass());
+	passes.add(llvm::createLoopVectorizePass());
+	passes.add(llvm::createInstructionCombiningPass());
+	passes.add(llvm::createCFGSimplificationPass());
+	passes.doInitialization();
+	for (auto& fn : module)
+		passes.run(fn);
+	passes.doFinalization();
+}
+
 int64_t execute(llvm::orc::ThreadSafeModule module, bool dump_ir) {
 	if (dump_ir) {
 		module.withModuleDo([](llvm::Module& m) {
 			m.print(llvm::outs(), nullptr);
 		});
 	}
-	llvm::ExitOnError check;
 	llvm::InitializeNativeTarget();
 	llvm::InitializeNativeTargetAsmPrinter();
+	module.withModuleDo(optimize);
+	llvm::ExitOnError check;
 	auto jit = check(llvm::orc::LLJITBuilder().create());
 	auto& es = jit->getExecutionSession();
 	auto* lib = es.getJITDylibByName("main");
@@ -2282,42 +4907,272 @@ int64_t execute(llvm::orc::ThreadSafeModule module, bool dump_ir) {
 		{ es.intern("release_weak"), { llvm::pointerToJITTargetAddress(&Object::release_weak), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("release"), { llvm::pointerToJITTargetAddress(&Object::release), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("alloc"), { llvm::pointerToJITTargetAddress(&Object::allocate), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("init_instance"), { llvm::pointerToJITTargetAddress(&Object::init_instance), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("allocate_raw"), { llvm::pointerToJITTargetAddress(&Object::allocate_raw), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("free_raw"), { llvm::pointerToJITTargetAddress(&Object::free_raw), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("mk_weak"), { llvm::pointerToJITTargetAddress(&Object::mk_weak), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("deref_weak"), { llvm::pointerToJITTargetAddress(&Object::deref_weak), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("reg_copy_fixer"), { llvm::pointerToJITTargetAddress(&Object::reg_copy_fixer), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("visit_object_field"), { llvm::pointerToJITTargetAddress(&Object::visit_object_field), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("visit_weak_field"), { llvm::pointerToJITTargetAddress(&Object::visit_weak_field), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("unshare_blob"), { llvm::pointerToJITTargetAddress(&Blob::unshare), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("take_array_items"), { llvm::pointerToJITTargetAddress(&Blob::take_items), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("return_array_items"), { llvm::pointerToJITTargetAddress(&Blob::return_items), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("channel_send_moved"), { llvm::pointerToJITTargetAddress(&Channel::send_moved), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_HeapImage_save"), { llvm::pointerToJITTargetAddress(&HeapImage::save), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_HeapImage_load"), { llvm::pointerToJITTargetAddress(&HeapImage::load), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_Container!copy"), { llvm::pointerToJITTargetAddress(&Blob::copy_container_fields), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_Container!dtor"), { llvm::pointerToJITTargetAddress(&Blob::dispose_container), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Container!visit"), { llvm::pointerToJITTargetAddress(&Blob::visit_container_fields), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_Container_size"), { llvm::pointerToJITTargetAddress(&Blob::get_size), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_Container_insert"), { llvm::pointerToJITTargetAddress(&Blob::insert_items), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_Container_move"), { llvm::pointerToJITTargetAddress(&Blob::move_array_items), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Container_moveRanges"), { llvm::pointerToJITTargetAddress(&Blob::move_ranges), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Container_reserve"), { llvm::pointerToJITTargetAddress(&Blob::reserve), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Container_shrink"), { llvm::pointerToJITTargetAddress(&Blob::shrink), llvm::JITSymbolFlags::Callable} },
 
 		{ es.intern("sys_Blob!copy"), { llvm::pointerToJITTargetAddress(&Blob::copy_container_fields), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_Blob!dtor"), { llvm::pointerToJITTargetAddress(&Blob::dispose_container), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob!visit"), { llvm::pointerToJITTargetAddress(&Blob::visit_container_fields), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_Blob_getAt"), { llvm::pointerToJITTargetAddress(&Blob::get_at), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_Blob_setAt"), { llvm::pointerToJITTargetAddress(&Blob::set_at), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_Blob_getByteAt"), { llvm::pointerToJITTargetAddress(&Blob::get_i8_at), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_Blob_setByteAt"), { llvm::pointerToJITTargetAddress(&Blob::set_i8_at), llvm::JITSymbolFlags::Callable} },
-		{ es.intern("sys_Blob_copy"), { llvm::pointerToJITTargetAddress(&Blob::copy), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_copy"), { llvm::pointerToJITTargetAddress(&Blob::blob_copy), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_fill"), { llvm::pointerToJITTargetAddress(&Blob::fill), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_sum"), { llvm::pointerToJITTargetAddress(&Blob::sum), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_min"), { llvm::pointerToJITTargetAddress(&Blob::min), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_max"), { llvm::pointerToJITTargetAddress(&Blob::max), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_compare"), { llvm::pointerToJITTargetAddress(&Blob::compare), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_findByte"), { llvm::pointerToJITTargetAddress(&Blob::find_byte), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_findInt"), { llvm::pointerToJITTargetAddress(&Blob::find_int), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_count"), { llvm::pointerToJITTargetAddress(&Blob::count), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_add"), { llvm::pointerToJITTargetAddress(&Blob::add), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_mul"), { llvm::pointerToJITTargetAddress(&Blob::mul), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_sort"), { llvm::pointerToJITTargetAddress(&Blob::sort), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_sortIndices"), { llvm::pointerToJITTargetAddress(&Blob::sort_indices), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_lowerBound"), { llvm::pointerToJITTargetAddress(&Blob::lower_bound), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_upperBound"), { llvm::pointerToJITTargetAddress(&Blob::upper_bound), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_hash"), { llvm::pointerToJITTargetAddress(&Blob::hash), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_hashInt"), { llvm::pointerToJITTargetAddress(&Blob::hash_int), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_putInt"), { llvm::pointerToJITTargetAddress(&Blob::put_int), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_putDouble"), { llvm::pointerToJITTargetAddress(&Blob::put_double), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_parseInt"), { llvm::pointerToJITTargetAddress(&Blob::parse_int), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_parseDouble"), { llvm::pointerToJITTargetAddress(&Blob::parse_double), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_numberEnd"), { llvm::pointerToJITTargetAddress(&Blob::number_end), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_Bitset!copy"), { llvm::pointerToJITTargetAddress(&Blob::copy_container_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Bitset!dtor"), { llvm::pointerToJITTargetAddress(&Blob::dispose_container), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Bitset!visit"), { llvm::pointerToJITTargetAddress(&Blob::visit_container_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Bitset_set"), { llvm::pointerToJITTargetAddress(&Blob::set_bit), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Bitset_clear"), { llvm::pointerToJITTargetAddress(&Blob::clear_bit), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Bitset_test"), { llvm::pointerToJITTargetAddress(&Blob::test_bit), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Bitset_and"), { llvm::pointerToJITTargetAddress(&Blob::bits_and), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Bitset_or"), { llvm::pointerToJITTargetAddress(&Blob::bits_or), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Bitset_xor"), { llvm::pointerToJITTargetAddress(&Blob::bits_xor), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Bitset_andNot"), { llvm::pointerToJITTargetAddress(&Blob::bits_andnot), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Bitset_popcount"), { llvm::pointerToJITTargetAddress(&Blob::popcount), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Bitset_findNext"), { llvm::pointerToJITTargetAddress(&Blob::find_set_bit), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_Blob_delete"), { llvm::pointerToJITTargetAddress(&Blob::delete_blob_items), llvm::JITSymbolFlags::Callable} },
 
 		{ es.intern("sys_Array!copy"), { llvm::pointerToJITTargetAddress(&Blob::copy_array_fields), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_Array!dtor"), { llvm::pointerToJITTargetAddress(&Blob::dispose_array), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Array!visit"), { llvm::pointerToJITTargetAddress(&Blob::visit_array_fields), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_Array_getAt"), { llvm::pointerToJITTargetAddress(&Blob::get_ref_at), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_Array_setAt"), { llvm::pointerToJITTargetAddress(&Blob::set_ref_at), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_Array_delete"), { llvm::pointerToJITTargetAddress(&Blob::delete_array_items), llvm::JITSymbolFlags::Callable} },
 
 		{ es.intern("sys_WeakArray!copy"), { llvm::pointerToJITTargetAddress(&Blob::copy_weak_array_fields), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_WeakArray!dtor"), { llvm::pointerToJITTargetAddress(&Blob::dispose_weak_array), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_WeakArray!visit"), { llvm::pointerToJITTargetAddress(&Blob::visit_weak_array_fields), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_WeakArray_getAt"), { llvm::pointerToJITTargetAddress(&Blob::get_weak_at), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_WeakArray_setAt"), { llvm::pointerToJITTargetAddress(&Blob::set_weak_at), llvm::JITSymbolFlags::Callable} },
 		{ es.intern("sys_WeakArray_delete"), { llvm::pointerToJITTargetAddress(&Blob::delete_weak_array_items), llvm::JITSymbolFlags::Callable} },
 
-		{ es.intern("sys_foreignTestFunction"), { llvm::pointerToJITTargetAddress(foreign_test_function), llvm::JITSymbolFlags::Callable} } }));
+		{ es.intern("sys_Map!copy"), { llvm::pointerToJITTargetAddress(&Map::copy_fields<int64_t, Map::INTS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Map!dtor"), { llvm::pointerToJITTargetAddress(&Map::dispose<int64_t, Map::INTS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Map!visit"), { llvm::pointerToJITTargetAddress(&Map::visit_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Map_size"), { llvm::pointerToJITTargetAddress(&Map::get_size), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_IntMap!copy"), { llvm::pointerToJITTargetAddress(&Map::copy_fields<int64_t, Map::INTS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntMap!dtor"), { llvm::pointerToJITTargetAddress(&Map::dispose<int64_t, Map::INTS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntMap!visit"), { llvm::pointerToJITTargetAddress(&Map::visit_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntMap_getAt"), { llvm::pointerToJITTargetAddress(&Map::get_int_at<int64_t>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntMap_setAt"), { llvm::pointerToJITTargetAddress(&Map::set_int_at<int64_t>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntMap_has"), { llvm::pointerToJITTargetAddress(&Map::has<int64_t>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntMap_delete"), { llvm::pointerToJITTargetAddress(&Map::erase<int64_t, Map::INTS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntMap_clear"), { llvm::pointerToJITTargetAddress(&Map::clear<int64_t, Map::INTS>), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_IntOwnMap!copy"), { llvm::pointerToJITTargetAddress(&Map::copy_fields<int64_t, Map::OWNS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntOwnMap!dtor"), { llvm::pointerToJITTargetAddress(&Map::dispose<int64_t, Map::OWNS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntOwnMap!visit"), { llvm::pointerToJITTargetAddress(&Map::visit_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntOwnMap_getAt"), { llvm::pointerToJITTargetAddress(&Map::get_own_at<int64_t>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntOwnMap_setAt"), { llvm::pointerToJITTargetAddress(&Map::set_own_at<int64_t>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntOwnMap_has"), { llvm::pointerToJITTargetAddress(&Map::has<int64_t>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntOwnMap_delete"), { llvm::pointerToJITTargetAddress(&Map::erase<int64_t, Map::OWNS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntOwnMap_clear"), { llvm::pointerToJITTargetAddress(&Map::clear<int64_t, Map::OWNS>), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_IntWeakMap!copy"), { llvm::pointerToJITTargetAddress(&Map::copy_fields<int64_t, Map::WEAKS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntWeakMap!dtor"), { llvm::pointerToJITTargetAddress(&Map::dispose<int64_t, Map::WEAKS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntWeakMap!visit"), { llvm::pointerToJITTargetAddress(&Map::visit_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntWeakMap_getAt"), { llvm::pointerToJITTargetAddress(&Map::get_weak_at<int64_t>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntWeakMap_setAt"), { llvm::pointerToJITTargetAddress(&Map::set_weak_at<int64_t>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntWeakMap_has"), { llvm::pointerToJITTargetAddress(&Map::has<int64_t>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntWeakMap_delete"), { llvm::pointerToJITTargetAddress(&Map::erase<int64_t, Map::WEAKS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntWeakMap_clear"), { llvm::pointerToJITTargetAddress(&Map::clear<int64_t, Map::WEAKS>), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_ObjIntMap!copy"), { llvm::pointerToJITTargetAddress(&Map::copy_fields<Object*, Map::INTS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjIntMap!dtor"), { llvm::pointerToJITTargetAddress(&Map::dispose<Object*, Map::INTS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjIntMap!visit"), { llvm::pointerToJITTargetAddress(&Map::visit_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjIntMap_getAt"), { llvm::pointerToJITTargetAddress(&Map::get_int_at<Object*>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjIntMap_setAt"), { llvm::pointerToJITTargetAddress(&Map::set_int_at<Object*>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjIntMap_has"), { llvm::pointerToJITTargetAddress(&Map::has<Object*>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjIntMap_delete"), { llvm::pointerToJITTargetAddress(&Map::erase<Object*, Map::INTS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjIntMap_clear"), { llvm::pointerToJITTargetAddress(&Map::clear<Object*, Map::INTS>), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_ObjOwnMap!copy"), { llvm::pointerToJITTargetAddress(&Map::copy_fields<Object*, Map::OWNS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjOwnMap!dtor"), { llvm::pointerToJITTargetAddress(&Map::dispose<Object*, Map::OWNS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjOwnMap!visit"), { llvm::pointerToJITTargetAddress(&Map::visit_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjOwnMap_getAt"), { llvm::pointerToJITTargetAddress(&Map::get_own_at<Object*>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjOwnMap_setAt"), { llvm::pointerToJITTargetAddress(&Map::set_own_at<Object*>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjOwnMap_has"), { llvm::pointerToJITTargetAddress(&Map::has<Object*>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjOwnMap_delete"), { llvm::pointerToJITTargetAddress(&Map::erase<Object*, Map::OWNS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjOwnMap_clear"), { llvm::pointerToJITTargetAddress(&Map::clear<Object*, Map::OWNS>), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_ObjWeakMap!copy"), { llvm::pointerToJITTargetAddress(&Map::copy_fields<Object*, Map::WEAKS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjWeakMap!dtor"), { llvm::pointerToJITTargetAddress(&Map::dispose<Object*, Map::WEAKS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjWeakMap!visit"), { llvm::pointerToJITTargetAddress(&Map::visit_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjWeakMap_getAt"), { llvm::pointerToJITTargetAddress(&Map::get_weak_at<Object*>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjWeakMap_setAt"), { llvm::pointerToJITTargetAddress(&Map::set_weak_at<Object*>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjWeakMap_has"), { llvm::pointerToJITTargetAddress(&Map::has<Object*>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjWeakMap_delete"), { llvm::pointerToJITTargetAddress(&Map::erase<Object*, Map::WEAKS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ObjWeakMap_clear"), { llvm::pointerToJITTargetAddress(&Map::clear<Object*, Map::WEAKS>), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_Deque!copy"), { llvm::pointerToJITTargetAddress(&Deque::copy_fields<Deque::INTS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Deque!dtor"), { llvm::pointerToJITTargetAddress(&Deque::dispose<Deque::INTS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Deque!visit"), { llvm::pointerToJITTargetAddress(&Deque::visit_fields<Deque::INTS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Deque_size"), { llvm::pointerToJITTargetAddress(&Deque::get_size), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_IntDeque!copy"), { llvm::pointerToJITTargetAddress(&Deque::copy_fields<Deque::INTS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntDeque!dtor"), { llvm::pointerToJITTargetAddress(&Deque::dispose<Deque::INTS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntDeque!visit"), { llvm::pointerToJITTargetAddress(&Deque::visit_fields<Deque::INTS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntDeque_pushBack"), { llvm::pointerToJITTargetAddress(&Deque::push_int_back), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntDeque_pushFront"), { llvm::pointerToJITTargetAddress(&Deque::push_int_front), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntDeque_popBack"), { llvm::pointerToJITTargetAddress(&Deque::pop_int_back), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntDeque_popFront"), { llvm::pointerToJITTargetAddress(&Deque::pop_int_front), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntDeque_getAt"), { llvm::pointerToJITTargetAddress(&Deque::get_int_at), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_IntDeque_clear"), { llvm::pointerToJITTargetAddress(&Deque::clear<Deque::INTS>), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_OwnDeque!copy"), { llvm::pointerToJITTargetAddress(&Deque::copy_fields<Deque::OWNS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_OwnDeque!dtor"), { llvm::pointerToJITTargetAddress(&Deque::dispose<Deque::OWNS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_OwnDeque!visit"), { llvm::pointerToJITTargetAddress(&Deque::visit_fields<Deque::OWNS>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_OwnDeque_pushBack"), { llvm::pointerToJITTargetAddress(&Deque::push_own_back), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_OwnDeque_pushFront"), { llvm::pointerToJITTargetAddress(&Deque::push_own_front), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_OwnDeque_popBack"), { llvm::pointerToJITTargetAddress(&Deque::pop_own_back), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_OwnDeque_popFront"), { llvm::pointerToJITTargetAddress(&Deque::pop_own_front), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_OwnDeque_getAt"), { llvm::pointerToJITTargetAddress(&Deque::get_own_at), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_OwnDeque_clear"), { llvm::pointerToJITTargetAddress(&Deque::clear<Deque::OWNS>), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_String!copy"), { llvm::pointerToJITTargetAddress(&String::copy_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_String!dtor"), { llvm::pointerToJITTargetAddress(&String::dispose), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_String!visit"), { llvm::pointerToJITTargetAddress(&String::visit_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_String_size"), { llvm::pointerToJITTargetAddress(&String::get_size), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_String_getAt"), { llvm::pointerToJITTargetAddress(&String::get_at), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_String_concat"), { llvm::pointerToJITTargetAddress(&String::concat), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_String_slice"), { llvm::pointerToJITTargetAddress(&String::slice), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_String_compare"), { llvm::pointerToJITTargetAddress(&String::compare), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_String_hash"), { llvm::pointerToJITTargetAddress(&String::hash), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_mapFile"), { llvm::pointerToJITTargetAddress(&Blob::map_file), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Blob_view"), { llvm::pointerToJITTargetAddress(&Blob::view), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_ByteBuffer!copy"), { llvm::pointerToJITTargetAddress(&ByteBuffer::copy_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer!dtor"), { llvm::pointerToJITTargetAddress(&ByteBuffer::dispose), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer!visit"), { llvm::pointerToJITTargetAddress(&ByteBuffer::visit_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_size"), { llvm::pointerToJITTargetAddress(&ByteBuffer::get_size), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_resize"), { llvm::pointerToJITTargetAddress(&ByteBuffer::resize), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_copy"), { llvm::pointerToJITTargetAddress(&ByteBuffer::copy), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_getAt"), { llvm::pointerToJITTargetAddress(&ByteBuffer::get_int<uint8_t, false>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_setAt"), { llvm::pointerToJITTargetAddress(&ByteBuffer::set_int<uint8_t, false>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_getI16"), { llvm::pointerToJITTargetAddress(&ByteBuffer::get_int<int16_t, false>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_getI32"), { llvm::pointerToJITTargetAddress(&ByteBuffer::get_int<int32_t, false>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_getI64"), { llvm::pointerToJITTargetAddress(&ByteBuffer::get_int<int64_t, false>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_getF64"), { llvm::pointerToJITTargetAddress(&ByteBuffer::get<double, false>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_getI16Be"), { llvm::pointerToJITTargetAddress(&ByteBuffer::get_int<int16_t, true>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_getI32Be"), { llvm::pointerToJITTargetAddress(&ByteBuffer::get_int<int32_t, true>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_getI64Be"), { llvm::pointerToJITTargetAddress(&ByteBuffer::get_int<int64_t, true>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_getF64Be"), { llvm::pointerToJITTargetAddress(&ByteBuffer::get<double, true>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_setI16"), { llvm::pointerToJITTargetAddress(&ByteBuffer::set_int<int16_t, false>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_setI32"), { llvm::pointerToJITTargetAddress(&ByteBuffer::set_int<int32_t, false>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_setI64"), { llvm::pointerToJITTargetAddress(&ByteBuffer::set_int<int64_t, false>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_setF64"), { llvm::pointerToJITTargetAddress(&ByteBuffer::set<double, false>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_setI16Be"), { llvm::pointerToJITTargetAddress(&ByteBuffer::set_int<int16_t, true>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_setI32Be"), { llvm::pointerToJITTargetAddress(&ByteBuffer::set_int<int32_t, true>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_setI64Be"), { llvm::pointerToJITTargetAddress(&ByteBuffer::set_int<int64_t, true>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_setF64Be"), { llvm::pointerToJITTargetAddress(&ByteBuffer::set<double, true>), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_appendByte"), { llvm::pointerToJITTargetAddress(&ByteBuffer::append_byte), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_appendBlob"), { llvm::pointerToJITTargetAddress(&ByteBuffer::append_blob), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_appendBuffer"), { llvm::pointerToJITTargetAddress(&ByteBuffer::append_buffer), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_appendInt"), { llvm::pointerToJITTargetAddress(&ByteBuffer::append_int), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_appendDouble"), { llvm::pointerToJITTargetAddress(&ByteBuffer::append_double), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_finish"), { llvm::pointerToJITTargetAddress(&ByteBuffer::finish), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_putInt"), { llvm::pointerToJITTargetAddress(&ByteBuffer::put_int), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_putDouble"), { llvm::pointerToJITTargetAddress(&ByteBuffer::put_double), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_parseInt"), { llvm::pointerToJITTargetAddress(&ByteBuffer::parse_int), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_parseDouble"), { llvm::pointerToJITTargetAddress(&ByteBuffer::parse_double), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_ByteBuffer_numberEnd"), { llvm::pointerToJITTargetAddress(&ByteBuffer::number_end), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_Rope!copy"), { llvm::pointerToJITTargetAddress(&Rope::copy_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Rope!dtor"), { llvm::pointerToJITTargetAddress(&Rope::dispose), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Rope!visit"), { llvm::pointerToJITTargetAddress(&Rope::visit_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Rope_size"), { llvm::pointerToJITTargetAddress(&Rope::get_size), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Rope_getAt"), { llvm::pointerToJITTargetAddress(&Rope::get_at), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Rope_appendBlob"), { llvm::pointerToJITTargetAddress(&Rope::append_blob), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Rope_append"), { llvm::pointerToJITTargetAddress(&Rope::append), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Rope_slice"), { llvm::pointerToJITTargetAddress(&Rope::slice), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Rope_finish"), { llvm::pointerToJITTargetAddress(&Rope::finish), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_Channel!copy"), { llvm::pointerToJITTargetAddress(&Channel::copy_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Channel!dtor"), { llvm::pointerToJITTargetAddress(&Channel::dispose), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Channel!visit"), { llvm::pointerToJITTargetAddress(&Channel::visit_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Channel_send"), { llvm::pointerToJITTargetAddress(&Channel::send), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Channel_receive"), { llvm::pointerToJITTargetAddress(&Channel::receive), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Channel_tryReceive"), { llvm::pointerToJITTargetAddress(&Channel::try_receive), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_Channel_close"), { llvm::pointerToJITTargetAddress(&Channel::close), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_File!copy"), { llvm::pointerToJITTargetAddress(&File::copy_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_File!dtor"), { llvm::pointerToJITTargetAddress(&File::dispose), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_File!visit"), { llvm::pointerToJITTargetAddress(&File::visit_fields), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_File_open"), { llvm::pointerToJITTargetAddress(&File::open), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_File_read"), { llvm::pointerToJITTargetAddress(&File::read), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_File_write"), { llvm::pointerToJITTargetAddress(&File::write), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_File_seek"), { llvm::pointerToJITTargetAddress(&File::seek), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_File_flush"), { llvm::pointerToJITTargetAddress(&File::flush), llvm::JITSymbolFlags::Callable} },
+
+		{ es.intern("sys_foreignTestFunction"), { llvm::pointerToJITTargetAddress(foreign_test_function), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_foreignTestEcho"), { llvm::pointerToJITTargetAddress(foreign_test_echo), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_foreignTestAllocate"), { llvm::pointerToJITTargetAddress(foreign_test_allocate), llvm::JITSymbolFlags::Callable} },
+		{ es.intern("sys_foreignTestFree"), { llvm::pointerToJITTargetAddress(foreign_test_free), llvm::JITSymbolFlags::Callable} } }));
 	check(jit->addIRModule(std::move(module)));
 	auto f_main = check(jit->lookup("main"));
 	auto main_addr = (int64_t(*)()) f_main.getAddress();
+	HeapImage::classes = reinterpret_cast<HeapImage::ClassEntry*>(check(jit->lookup("!classes")).getAddress());
+	for (auto c = HeapImage::classes; c->name; c++) {
+		if (strcmp(c->name, "sys_String") == 0)
+			String::cls_dispatcher = c->dispatcher;
+		else if (strcmp(c->name, "sys_Blob") == 0)
+			Blob::cls_dispatcher = c->dispatcher;
+		else if (strcmp(c->name, "sys_File") == 0)
+			File::cls_dispatcher = c->dispatcher;
+		else if (strcmp(c->name, "sys_Rope") == 0)
+			Rope::cls_dispatcher = c->dispatcher;
+	}
 	foreign_test_function_state = 0;
  	auto r = main_addr();
+	HeapImage::classes = nullptr;
+	String::cls_dispatcher = nullptr;
+	Blob::cls_dispatcher = nullptr;
+	File::cls_dispatcher = nullptr;
+	Rope::cls_dispatcher = nullptr;
 	assert(leak_detector_ok());
 	return r;
 }
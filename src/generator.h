@@ -10,4 +10,7 @@ int64_t execute(llvm::orc::ThreadSafeModule module, bool dump_ir = false);
 
 int64_t generate_and_execute(ltm::pin<ast::Ast> ast, bool dump_ir);  // used without import in `compiler-test.cpp`
 
+// File used by `sys_HeapImage_save/load`, empty string disables heap images.
+void set_heap_image_path(std::string path);  // used without import in `compiler-test.cpp`
+
 #endif  // _AK_GENERATOR_H_
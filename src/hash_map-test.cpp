@@ -0,0 +1,93 @@
+#include <unordered_map>
+#include "fake-gunit.h"
+#include "hash_map.h"
+
+namespace {
+
+using hash_map::Table;
+
+int64_t key_at(int64_t i) { return i * 0x9E3779B97F4A7C15ll; }
+
+TEST(HashMap, InsertFind) {
+	Table t{ 0, 0, 0, nullptr };
+	ASSERT_TRUE(hash_map::find(t, 1) == nullptr);
+	for (int64_t i = 0; i < 1000; i++) {
+		bool inserted = false;
+		*hash_map::insert(t, key_at(i), inserted) = i;
+		ASSERT_TRUE(inserted);
+	}
+	ASSERT_EQ(t.size, 1000);
+	ASSERT_EQ(t.capacity, 2048);
+	for (int64_t i = 0; i < 1000; i++) {
+		bool inserted = true;
+		ASSERT_EQ(*hash_map::insert(t, key_at(i), inserted), i);
+		ASSERT_FALSE(inserted);
+		ASSERT_EQ(*hash_map::find(t, key_at(i)), i);
+	}
+	ASSERT_TRUE(hash_map::find(t, key_at(1000)) == nullptr);
+	hash_map::reset(t);
+	ASSERT_EQ(t.size, 0);
+	ASSERT_TRUE(hash_map::find(t, key_at(1)) == nullptr);
+}
+
+TEST(HashMap, EraseReusesSlots) {
+	Table t{ 0, 0, 0, nullptr };
+	std::unordered_map<int64_t, int64_t> expected;
+	bool inserted;
+	// Churn keeps the size small, so tombstones must be reclaimed without growing.
+	for (int64_t i = 0; i < 20000; i++) {
+		*hash_map::insert(t, key_at(i), inserted) = i;
+		expected[key_at(i)] = i;
+		if (i >= 50) {
+			int64_t old = 0;
+			ASSERT_TRUE(hash_map::erase(t, key_at(i - 50), &old));
+			ASSERT_EQ(old, i - 50);
+			ASSERT_FALSE(hash_map::erase(t, key_at(i - 50), &old));
+			expected.erase(key_at(i - 50));
+		}
+	}
+	ASSERT_EQ(t.size, expected.size());
+	ASSERT_TRUE(t.capacity <= 128);
+	for (auto& kv : expected)
+		ASSERT_EQ(*hash_map::find(t, kv.first), kv.second);
+	hash_map::reset(t);
+}
+
+TEST(HashMap, CopyAndForEach) {
+	Table t{ 0, 0, 0, nullptr };
+	bool inserted;
+	for (int64_t i = 0; i < 100; i++)
+		*hash_map::insert(t, i, inserted) = i * 2;
+	Table c;
+	hash_map::copy(c, t);
+	hash_map::for_each(t, [&](size_t index, int64_t key, int64_t) {
+		if (key % 2)
+			hash_map::erase_at(t, index);
+	});
+	ASSERT_EQ(t.size, 50);
+	ASSERT_EQ(c.size, 100);
+	int64_t sum = 0;
+	hash_map::for_each(c, [&](size_t, int64_t key, int64_t& value) {
+		ASSERT_EQ(value, key * 2);
+		sum += value;
+	});
+	ASSERT_EQ(sum, 9900);
+	ASSERT_TRUE(hash_map::find(t, 3) == nullptr);
+	ASSERT_EQ(*hash_map::find(c, 3), 6);
+	hash_map::reset(t);
+	hash_map::reset(c);
+}
+
+TEST(HashMap, HashBytes) {
+	const char text[] = "0123456789abcdef0123456789abcdef";
+	ASSERT_EQ(hash_map::hash_bytes(text + 2, 13), hash_map::hash_bytes(text + 18, 13));
+	std::unordered_map<uint64_t, size_t> seen;
+	for (size_t size = 0; size < 20; size++) {
+		auto h = hash_map::hash_bytes(text, size);
+		ASSERT_EQ(seen.count(h), 0);
+		seen[h] = size;
+	}
+	ASSERT_FALSE(hash_map::hash_bytes("ab", 2) == hash_map::hash_bytes("ba", 2));
+}
+
+}  // namespace
@@ -0,0 +1,207 @@
+#include "hash_map.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HASH_MAP_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace hash_map {
+
+namespace {
+
+const int8_t EMPTY = -128;
+const int8_t DELETED = -2;
+
+uint64_t hash(int64_t key) {  // murmur3 finalizer
+	auto h = uint64_t(key);
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+int8_t h2(uint64_t hash) { return int8_t(hash & 0x7f); }  // stored in control bytes
+uint64_t h1(uint64_t hash) { return hash >> 7; }  // selects the first group to probe
+
+unsigned lowest_bit(uint32_t mask) {
+#ifdef _MSC_VER
+	unsigned long r;
+	_BitScanForward(&r, mask);
+	return r;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// Bit masks over a group of GROUP_SIZE control bytes.
+#ifdef HASH_MAP_SSE2
+uint32_t match(const int8_t* group, int8_t h2) {
+	auto ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+	return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2))));
+}
+uint32_t match_empty(const int8_t* group) {
+	return match(group, EMPTY);
+}
+uint32_t match_free(const int8_t* group) {  // EMPTY or DELETED, the only negative control bytes
+	return uint32_t(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+}
+#else
+uint32_t match(const int8_t* group, int8_t h2) {
+	uint32_t r = 0;
+	for (size_t i = 0; i < GROUP_SIZE; i++)
+		r |= uint32_t(group[i] == h2) << i;
+	return r;
+}
+uint32_t match_empty(const int8_t* group) {
+	return match(group, EMPTY);
+}
+uint32_t match_free(const int8_t* group) {
+	uint32_t r = 0;
+	for (size_t i = 0; i < GROUP_SIZE; i++)
+		r |= uint32_t(group[i] < 0) << i;
+	return r;
+}
+#endif
+
+// Visits groups in triangular order, that covers all groups of power of 2 count.
+struct Probe {
+	size_t group_mask;
+	size_t group;
+	size_t step = 0;
+	Probe(const Table& table, uint64_t hash)
+		: group_mask(table.capacity / GROUP_SIZE - 1)
+		, group(h1(hash) & group_mask) {}
+	size_t offset() const { return group * GROUP_SIZE; }
+	void next() { group = (group + ++step) & group_mask; }
+};
+
+uint64_t max_load(uint64_t capacity) { return capacity - capacity / 8; }
+
+void allocate(Table& table, uint64_t capacity) {
+	table.capacity = capacity;
+	table.size = 0;
+	table.growth_left = max_load(capacity);
+	table.data = new int64_t[capacity / sizeof(int64_t) + capacity * 2];
+	memset(table.data, EMPTY, capacity);
+}
+
+size_t find_free(const Table& table, uint64_t hash) {
+	for (Probe p(table, hash);; p.next()) {
+		if (auto free = match_free(table.ctrl() + p.offset()))
+			return p.offset() + lowest_bit(free);
+	}
+}
+
+void rehash(Table& table, uint64_t capacity) {
+	auto old = table;
+	allocate(table, capacity);
+	for_each(old, [&](size_t, int64_t key, int64_t value) {
+		auto key_hash = hash(key);
+		auto i = find_free(table, key_hash);
+		table.ctrl()[i] = h2(key_hash);
+		table.keys()[i] = key;
+		table.values()[i] = value;
+	});
+	table.size = old.size;
+	table.growth_left -= old.size;
+	delete[] old.data;
+}
+
+}  // namespace
+
+int64_t* find(const Table& table, int64_t key) {
+	if (!table.capacity)
+		return nullptr;
+	auto key_hash = hash(key);
+	auto keys = table.keys();
+	for (Probe p(table, key_hash);; p.next()) {
+		auto group = table.ctrl() + p.offset();
+		for (auto m = match(group, h2(key_hash)); m; m &= m - 1) {
+			auto i = p.offset() + lowest_bit(m);
+			if (keys[i] == key)
+				return table.values() + i;
+		}
+		if (match_empty(group))
+			return nullptr;
+	}
+}
+
+int64_t* insert(Table& table, int64_t key, bool& inserted) {
+	if (auto r = find(table, key)) {
+		inserted = false;
+		return r;
+	}
+	inserted = true;
+	auto key_hash = hash(key);
+	if (table.growth_left == 0) {
+		// Reclaim tombstones in place if it frees enough room, otherwise grow.
+		rehash(table, table.size * 2 < max_load(table.capacity) ? table.capacity : table.capacity ? table.capacity * 2 : GROUP_SIZE);
+	}
+	auto i = find_free(table, key_hash);
+	if (table.ctrl()[i] == EMPTY)
+		table.growth_left--;
+	table.ctrl()[i] = h2(key_hash);
+	table.keys()[i] = key;
+	table.values()[i] = 0;
+	table.size++;
+	return table.values() + i;
+}
+
+void erase_at(Table& table, size_t index) {
+	// A group having an empty slot stops all probes, so no other key depends on this slot being occupied.
+	if (match_empty(table.ctrl() + index / GROUP_SIZE * GROUP_SIZE)) {
+		table.ctrl()[index] = EMPTY;
+		table.growth_left++;
+	} else {
+		table.ctrl()[index] = DELETED;
+	}
+	table.size--;
+}
+
+bool erase(Table& table, int64_t key, int64_t* old_value) {
+	auto value = find(table, key);
+	if (!value)
+		return false;
+	*old_value = *value;
+	erase_at(table, value - table.values());
+	return true;
+}
+
+void copy(Table& dst, const Table& src) {
+	dst = src;
+	if (src.capacity) {
+		auto words = src.capacity / sizeof(int64_t) + src.capacity * 2;
+		dst.data = new int64_t[words];
+		memcpy(dst.data, src.data, words * sizeof(int64_t));
+	}
+}
+
+void reset(Table& table) {
+	delete[] table.data;
+	table = Table{ 0, 0, 0, nullptr };
+}
+
+uint64_t hash_bytes(const void* data, size_t size) {
+	// Word at a time, the tail is read as a partial word, all mixed by the same finalizer as int keys.
+	auto bytes = static_cast<const char*>(data);
+	uint64_t h = size * 0x9e3779b97f4a7c15ull;
+	for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), bytes += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, bytes, sizeof(word));
+		h = (h ^ hash(int64_t(word))) * 0x9e3779b97f4a7c15ull;
+	}
+	if (size) {
+		uint64_t word = 0;
+		memcpy(&word, bytes, size);
+		h = (h ^ hash(int64_t(word))) * 0x9e3779b97f4a7c15ull;
+	}
+	return hash(int64_t(h));
+}
+
+}  // namespace hash_map
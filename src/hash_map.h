@@ -0,0 +1,51 @@
+#ifndef _HASH_MAP_H_
+#define _HASH_MAP_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Open addressing hash table from int64 keys to int64 slots.
+// Slots are grouped by 16, each slot has a control byte holding either 7 bits of key hash or EMPTY/DELETED marker.
+// Lookups match a whole group of control bytes at once with SSE2 and compare keys only on hash matches.
+// The table doesn't own or interpret values, it's up to the caller to retain/release them.
+namespace hash_map {
+
+constexpr size_t GROUP_SIZE = 16;
+
+// Lives inline in the runtime map objects, layout is mirrored by sys_Map fields.
+struct Table {
+	uint64_t size;
+	uint64_t capacity;     // slots, 0 or a power of 2 >= GROUP_SIZE
+	uint64_t growth_left;  // inserts to empty slots allowed before rehash
+	int64_t* data;         // `capacity` control bytes, then keys, then values
+
+	int8_t* ctrl() const { return reinterpret_cast<int8_t*>(data); }
+	int64_t* keys() const { return data + capacity / sizeof(int64_t); }
+	int64_t* values() const { return keys() + capacity; }
+};
+
+int64_t* find(const Table& table, int64_t key);  // value slot or nullptr
+int64_t* insert(Table& table, int64_t key, bool& inserted);  // existing value slot or a new zeroed one
+bool erase(Table& table, int64_t key, int64_t* old_value);
+void erase_at(Table& table, size_t index);
+void copy(Table& dst, const Table& src);  // dst is uninitialized, values are copied bitwise
+void reset(Table& table);  // frees storage, leaving an empty table, doesn't touch values
+
+uint64_t hash_bytes(const void* data, size_t size);  // for byte string keys, like sys_String
+
+// Calls `fn(size_t index, int64_t& key, int64_t& value)` for all occupied slots.
+// `fn` may erase the visited slot with `erase_at`.
+template<typename FN>
+void for_each(const Table& table, FN&& fn) {
+	auto ctrl = table.ctrl();
+	auto keys = table.keys();
+	auto values = table.values();
+	for (size_t i = 0; i < table.capacity; i++) {
+		if (ctrl[i] >= 0)
+			fn(i, keys[i], values[i]);
+	}
+}
+
+}  // namespace hash_map
+
+#endif  // _HASH_MAP_H_
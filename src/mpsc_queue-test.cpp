@@ -0,0 +1,90 @@
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "fake-gunit.h"
+#include "mpsc_queue.h"
+
+namespace {
+
+void* as_value(uintptr_t v) { return reinterpret_cast<void*>(v); }
+uintptr_t from_value(void* v) { return reinterpret_cast<uintptr_t>(v); }
+
+TEST(MpscQueue, SingleThread) {
+	mpsc_queue::Queue q;
+	ASSERT_TRUE(q.try_pop() == nullptr);
+	for (uintptr_t i = 1; i <= 5; i++)
+		q.push(as_value(i));
+	ASSERT_EQ(from_value(q.try_pop()), 1);
+	ASSERT_EQ(from_value(q.pop()), 2);
+	q.push(as_value(6));
+	q.close();
+	uintptr_t sum = 0;
+	while (auto v = q.pop())
+		sum = sum * 10 + from_value(v);
+	ASSERT_EQ(sum, 3456);
+	ASSERT_TRUE(q.try_pop() == nullptr);
+	q.push(as_value(7));  // left for the destructor
+}
+
+// Producers push (producer, sequence) pairs, the consumer checks that each producer's values come in order.
+TEST(MpscQueue, ProducersAndBlockingConsumer) {
+	const uintptr_t producers = 4;
+	const uintptr_t per_producer = 100000;
+	mpsc_queue::Queue q;
+	std::vector<uintptr_t> next(producers, 0);
+	uintptr_t received = 0;
+	bool in_order = true;
+	std::thread consumer([&] {
+		while (auto v = q.pop()) {
+			auto producer = (from_value(v) >> 32) - 1;
+			in_order &= (from_value(v) & 0xffffffff) == next[producer]++;
+			received++;
+		}
+	});
+	std::vector<std::thread> threads;
+	for (uintptr_t p = 1; p <= producers; p++) {
+		threads.emplace_back([&q, p, per_producer] {
+			for (uintptr_t i = 0; i < per_producer; i++) {
+				q.push(as_value(p << 32 | i));
+				if (i % 10000 == 0)  // let the consumer run dry and park now and then
+					std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			}
+		});
+	}
+	for (auto& t : threads)
+		t.join();
+	q.close();
+	consumer.join();
+	ASSERT_TRUE(in_order);
+	ASSERT_EQ(received, producers * per_producer);
+	ASSERT_TRUE(q.try_pop() == nullptr);
+}
+
+TEST(MpscQueue, CloseWakesParkedConsumer) {
+	mpsc_queue::Queue q;
+	void* result = as_value(1);
+	std::thread consumer([&] { result = q.pop(); });
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	q.close();
+	consumer.join();
+	ASSERT_TRUE(result == nullptr);
+}
+
+TEST(MpscQueue, ConsumerDestroysClosedQueue) {
+	for (int round = 0; round < 100; round++) {
+		auto q = new mpsc_queue::Queue;
+		std::thread producer([q] {
+			for (int i = 1; i <= 10; i++)
+				q->push(as_value(i));
+			q->close();
+		});
+		int popped = 0;
+		while (q->pop())
+			popped++;
+		delete q;  // the producer may still be returning from `close`
+		producer.join();
+		ASSERT_EQ(popped, 10);
+	}
+}
+
+}  // namespace
@@ -0,0 +1,111 @@
+#include "mpsc_queue.h"
+
+#include <thread>
+
+namespace mpsc_queue {
+
+namespace {
+
+constexpr int SPINS_BEFORE_PARKING = 100;
+
+}  // namespace
+
+Queue::Queue()
+	: head(&stub)
+	, tail(&stub)
+	, closed(false)
+	, parked(false) {
+	stub.next.store(nullptr, std::memory_order_relaxed);
+	stub.value = nullptr;
+}
+
+Queue::~Queue() {
+	std::lock_guard<std::mutex> lock(mutex);  // waits for `close` that woke the consumer
+	while (auto n = pop_node())
+		delete n;
+}
+
+void Queue::push_node(Node* n) {
+	n->next.store(nullptr, std::memory_order_relaxed);
+	// Until the link below, the consumer sees `head` moved but can't reach `n`, see pop_node.
+	auto prev = head.exchange(n, std::memory_order_seq_cst);  // seq_cst pairs with `parked`, see pop
+	prev->next.store(n, std::memory_order_release);
+}
+
+void Queue::push(void* value) {
+	push_node(new Node{ { nullptr }, value });
+	if (parked.load(std::memory_order_seq_cst)) {
+		std::lock_guard<std::mutex> lock(mutex);
+		wakeup.notify_one();
+	}
+}
+
+// Closing is done under the mutex, so a consumer that sees `closed` and destroys the queue
+// waits in the destructor till the closing producer stops touching it.
+void Queue::close() {
+	std::lock_guard<std::mutex> lock(mutex);
+	closed.store(true, std::memory_order_seq_cst);
+	wakeup.notify_one();
+}
+
+// Nodes are popped from `tail` while the next one is linked, the last node is only popped
+// after the stub is pushed behind it, so `tail` never becomes null.
+Node* Queue::pop_node() {
+	auto t = tail;
+	auto next = t->next.load(std::memory_order_acquire);
+	if (t == &stub) {
+		if (!next)
+			return nullptr;
+		tail = t = next;
+		next = next->next.load(std::memory_order_acquire);
+	}
+	if (next) {
+		tail = next;
+		return t;
+	}
+	if (t != head.load(std::memory_order_acquire))
+		return nullptr;  // a push is in progress
+	push_node(&stub);
+	next = t->next.load(std::memory_order_acquire);
+	if (!next)
+		return nullptr;
+	tail = next;
+	return t;
+}
+
+bool Queue::is_empty() {
+	return tail == &stub && head.load(std::memory_order_seq_cst) == &stub;
+}
+
+void* Queue::try_pop() {
+	auto n = pop_node();
+	if (!n)
+		return nullptr;
+	auto r = n->value;
+	delete n;
+	return r;
+}
+
+void* Queue::pop() {
+	for (int spins = 0;; spins++) {
+		if (auto r = try_pop())
+			return r;
+		if (closed.load(std::memory_order_acquire) && is_empty())
+			return nullptr;
+		if (spins < SPINS_BEFORE_PARKING) {
+			std::this_thread::yield();
+			continue;
+		}
+		// Producers check `parked` after their exchange on `head`, and `is_empty` here reads `head` after
+		// setting `parked`, so either the push is seen here, or the producer sees `parked` and notifies.
+		// The notification takes the mutex, so it can't slip in between this check and the wait.
+		std::unique_lock<std::mutex> lock(mutex);
+		parked.store(true, std::memory_order_seq_cst);
+		if (is_empty() && !closed.load(std::memory_order_seq_cst))
+			wakeup.wait(lock);
+		parked.store(false, std::memory_order_relaxed);
+		spins = 0;
+	}
+}
+
+}  // namespace mpsc_queue
@@ -0,0 +1,50 @@
+#ifndef _MPSC_QUEUE_H_
+#define _MPSC_QUEUE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+// Lock-free multi-producer single-consumer FIFO of non-null pointers, after Dmitry Vyukov's intrusive MPSC queue.
+// `push` is one atomic exchange and a store, it never waits for other producers or the consumer.
+// `try_pop`, `pop` and `close` checks are for the single consumer thread.
+// A blocked `pop` spins for a while and then parks on a condition variable, producers touch the mutex
+// only when they see a parked consumer.
+// The queue doesn't own or interpret values, it's up to the caller to drain it before destruction.
+namespace mpsc_queue {
+
+struct Node {
+	std::atomic<Node*> next;
+	void* value;
+};
+
+class Queue {
+public:
+	Queue();
+	~Queue();  // frees nodes still queued, not their values
+	Queue(const Queue&) = delete;
+	Queue& operator=(const Queue&) = delete;
+
+	void push(void* value);  // any thread
+	void close();  // any thread, producers should not push after it, the consumer can destroy the queue once `pop` returns null
+
+	void* try_pop();  // null if empty, can miss a push that is still in progress
+	void* pop();  // waits for a value, null once the queue is closed and drained
+
+private:
+	void push_node(Node* n);
+	Node* pop_node();
+	bool is_empty();  // consumer-side, counts pushes in progress as values
+
+	std::atomic<Node*> head;  // last pushed node, producers swap it
+	Node* tail;  // next node to pop, owned by the consumer
+	Node stub;  // keeps the list non-empty
+	std::atomic<bool> closed;
+	std::atomic<bool> parked;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+};
+
+}  // namespace mpsc_queue
+
+#endif  // _MPSC_QUEUE_H_
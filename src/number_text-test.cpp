@@ -0,0 +1,77 @@
+#include <cstring>
+#include <limits>
+#include <string>
+#include "fake-gunit.h"
+#include "number_text.h"
+
+namespace {
+
+int64_t parsed_int(const std::string& text, size_t expected_size) {
+	int64_t r = -1;
+	ASSERT_EQ(number_text::parse_int(text.data(), text.size(), r), expected_size);
+	return r;
+}
+
+TEST(NumberText, FormatInt) {
+	char text[number_text::MAX_INT_CHARS];
+	for (int64_t v : { int64_t(0), int64_t(7), int64_t(-42), int64_t(1234567890123), INT64_MAX, INT64_MIN }) {
+		auto size = number_text::format_int(v, text);
+		ASSERT_EQ(std::string(text, size), std::to_string(v));
+	}
+}
+
+TEST(NumberText, FormatDoubleRoundTrips) {
+	char text[number_text::MAX_DOUBLE_CHARS];
+	ASSERT_EQ(std::string(text, number_text::format_double(0.1, text)), "0.1");
+	ASSERT_EQ(std::string(text, number_text::format_double(-2.5, text)), "-2.5");
+	ASSERT_EQ(std::string(text, number_text::format_double(100, text)), "100");
+	uint64_t bits = 0x12345;
+	for (int i = 0; i < 10000; i++) {
+		bits = bits * 6364136223846793005ull + 1442695040888963407ull;
+		double v;
+		memcpy(&v, &bits, sizeof(v));
+		if (v != v)
+			continue;
+		auto size = number_text::format_double(v, text);
+		double back = 0;
+		ASSERT_EQ(number_text::parse_double(text, size, back), size);
+		ASSERT_TRUE(back == v);
+	}
+	auto size = number_text::format_double(-std::numeric_limits<double>::denorm_min(), text);
+	ASSERT_TRUE(size <= number_text::MAX_DOUBLE_CHARS);
+}
+
+TEST(NumberText, ParseInt) {
+	ASSERT_EQ(parsed_int("0", 1), 0);
+	ASSERT_EQ(parsed_int("123,", 3), 123);
+	ASSERT_EQ(parsed_int("-98765432101234567 ", 18), -98765432101234567);
+	ASSERT_EQ(parsed_int("9223372036854775807", 19), INT64_MAX);
+	ASSERT_EQ(parsed_int("-9223372036854775808", 20), INT64_MIN);
+	ASSERT_EQ(parsed_int("00000000000000000000000000042x", 29), 42);
+	ASSERT_EQ(parsed_int("9223372036854775808", 0), -1);
+	ASSERT_EQ(parsed_int("99999999999999999999", 0), -1);
+	ASSERT_EQ(parsed_int("-", 0), -1);
+	ASSERT_EQ(parsed_int("x1", 0), -1);
+	ASSERT_EQ(parsed_int("", 0), -1);
+	// Every length and every place of the first non-digit, around the 16-byte scan and 8-digit conversion.
+	std::string digits = "1234567890123456789";
+	for (size_t n = 1; n <= digits.size(); n++) {
+		for (const char* tail : { "", ":", "/", " 12345678901234567890" }) {
+			int64_t expected = std::stoll(digits.substr(0, n));
+			ASSERT_EQ(parsed_int(digits.substr(0, n) + tail, n), expected);
+			ASSERT_EQ(parsed_int("-" + digits.substr(0, n) + tail, n + 1), -expected);
+		}
+	}
+}
+
+TEST(NumberText, ParseDouble) {
+	double v = 0;
+	ASSERT_EQ(number_text::parse_double("2.5e3,", 6, v), 5);
+	ASSERT_TRUE(v == 2500);
+	ASSERT_EQ(number_text::parse_double("-17", 3, v), 3);
+	ASSERT_TRUE(v == -17);
+	ASSERT_EQ(number_text::parse_double("e5", 2, v), 0);
+	ASSERT_TRUE(v == -17);
+}
+
+}  // namespace
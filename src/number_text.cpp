@@ -0,0 +1,91 @@
+#include "number_text.h"
+
+#include <charconv>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NUMBER_TEXT_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace number_text {
+
+namespace {
+
+inline bool is_digit(char c) { return unsigned(c - '0') < 10; }
+
+size_t digit_run(const char* text, size_t size) {  // leading digits count
+	size_t i = 0;
+#ifdef NUMBER_TEXT_SSE2
+	auto zero = _mm_set1_epi8('0');
+	auto nine = _mm_set1_epi8(9);
+	for (; i + 16 <= size; i += 16) {
+		auto v = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i)), zero);
+		unsigned non_digits = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, nine), nine)) & 0xffff;
+		if (non_digits) {
+#ifdef _MSC_VER
+			unsigned long at;
+			_BitScanForward(&at, non_digits);
+			return i + at;
+#else
+			return i + __builtin_ctz(non_digits);
+#endif
+		}
+	}
+#endif
+	while (i < size && is_digit(text[i]))
+		i++;
+	return i;
+}
+
+// Eight digits to their value in three multiplications, digit bytes are combined pairwise in one 64-bit word.
+inline uint64_t parse8(const char* text) {
+	uint64_t v;
+	memcpy(&v, text, sizeof(v));  // little-endian, first digit in the lowest byte
+	v -= 0x3030303030303030ull;
+	v = v * 10 + (v >> 8);  // 2-digit values in even bytes
+	return ((v & 0x000000ff000000ffull) * (100 + (1000000ull << 32)) +
+		((v >> 16) & 0x000000ff000000ffull) * (1 + (10000ull << 32))) >> 32;
+}
+
+}  // namespace
+
+size_t format_int(int64_t value, char* dst) {
+	return std::to_chars(dst, dst + MAX_INT_CHARS, value).ptr - dst;
+}
+
+size_t format_double(double value, char* dst) {
+	return std::to_chars(dst, dst + MAX_DOUBLE_CHARS, value).ptr - dst;
+}
+
+size_t parse_int(const char* text, size_t size, int64_t& value) {
+	size_t sign = size && text[0] == '-';
+	auto digits = digit_run(text + sign, size - sign);
+	if (!digits)
+		return 0;
+	auto p = text + sign;
+	auto end = p + digits;
+	while (end - p > 19 && *p == '0')  // longer runs overflow unless padded with zeros
+		p++;
+	if (end - p > 19)
+		return 0;
+	uint64_t r = 0;
+	for (; end - p >= 8; p += 8)
+		r = r * 100000000 + parse8(p);
+	for (; p != end; p++)
+		r = r * 10 + unsigned(*p - '0');
+	if (r > uint64_t(INT64_MAX) + sign)
+		return 0;
+	value = int64_t(sign ? 0 - r : r);
+	return sign + digits;
+}
+
+size_t parse_double(const char* text, size_t size, double& value) {
+	auto r = std::from_chars(text, text + size, value);
+	return r.ec == std::errc() ? r.ptr - text : 0;
+}
+
+}  // namespace number_text
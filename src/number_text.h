@@ -0,0 +1,27 @@
+#ifndef _NUMBER_TEXT_H_
+#define _NUMBER_TEXT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Decimal text of int64 and double values, written to and read from raw bytes.
+// Doubles are written as the shortest text that reads back to the same value.
+namespace number_text {
+
+constexpr size_t MAX_INT_CHARS = 20;  // "-9223372036854775808"
+constexpr size_t MAX_DOUBLE_CHARS = 24;  // "-2.2250738585072014e-308"
+
+// These write to `dst` with room for MAX_*_CHARS and return the number of chars written.
+size_t format_int(int64_t value, char* dst);
+size_t format_double(double value, char* dst);
+
+// These parse a number at the start of `size` bytes and return the number of chars it takes,
+// or 0 if there's no number or it doesn't fit, leaving `value` untouched.
+// Ints are an optional '-' followed by decimal digits, digit runs are found and converted 8 at a time.
+// Doubles also take fractions, exponents, "inf" and "nan", as std::from_chars does.
+size_t parse_int(const char* text, size_t size, int64_t& value);
+size_t parse_double(const char* text, size_t size, double& value);
+
+}  // namespace number_text
+
+#endif  // _NUMBER_TEXT_H_
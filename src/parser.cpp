@@ -180,16 +180,11 @@ struct Parser {
 		}
 		if (match("&")) {
 			auto r = make<ast::MkWeakOp>();
-			auto get = make<ast::Get>();
-			get->var_name = expect_domain_name("class or interface name");
-			r->p = get;
+			r->p = parse_class_name(expect_domain_name("class or interface name"));
 			return r;
 		}
-		if (match("@")) {
-			auto get = make<ast::Get>();
-			get->var_name = expect_domain_name("class or interface name");
-			return get;
-		}
+		if (match("@"))
+			return parse_class_name(expect_domain_name("class or interface name"));
 		auto parse_params = [&](pin<ast::MkLambda> fn) {
 			if (!match(")")) {
 				for (;;) {
@@ -211,15 +206,29 @@ struct Parser {
 			return parse_params(make<ast::MkLambda>());
 		if (auto name = match_domain_name("class or interface name")) {
 			auto r = make<ast::RefOp>();
-			auto get = make<ast::Get>();
-			get->var_name = *name;
-			r->p = get;
+			r->p = parse_class_name(*name);
 			return r;
 		}
 		// TODO &(T,T)T - delegate
 		error("Expected type name");
 	}
 
+	pin<Action> parse_class_name(pin<Name> name) {
+		auto get = make<ast::Get>();
+		get->var_name = name;
+		return parse_item_class(get);
+	}
+
+	pin<Action> parse_item_class(pin<Action> cls) {  // makes typed container `Name(ItemName)` if `(` follows
+		if (!match("("))
+			return cls;
+		auto r = make<ast::Call>();
+		r->callee = cls;
+		r->params.push_back(parse_class_name(expect_domain_name("item class name")));
+		expect(")");
+		return r;
+	}
+
 	pin<Action> parse_statement() {
 		auto r = parse_expression();
 		if (auto as_get = dom::strict_cast<ast::Get>(r)) {
@@ -371,7 +380,8 @@ struct Parser {
 					error("expected variable name in front of := operator");
 				}
 			} else if (match("~")) {
-				r = fill(make<ast::CastOp>(), r, parse_unar_head());
+				auto target = parse_unar_head();
+				r = fill(make<ast::CastOp>(), r, dom::strict_cast<ast::Get>(target) ? parse_item_class(target) : target);
 			} else
 				return r;
 		}
@@ -423,6 +433,8 @@ struct Parser {
 			if (auto v = get_if<double>(&*n))
 				return mk_const<ast::ConstDouble>(*v);
 		}
+		if (*cur == '"')
+			return parse_string();
 		if (match("{")) {
 			auto r = make<ast::Block>();
 			parse_statement_sequence(r->body);
@@ -452,6 +464,17 @@ struct Parser {
 			return fill(make<ast::ToFloatOp>(), parse_expression_in_parethesis());
 		if (match("loop")) 
 			return fill(make<ast::Loop>(), parse_unar());
+		if (match("each")) {
+			auto container = parse_expression_in_parethesis();
+			auto body = make<ast::Block>();
+			body->names.push_back(make<ast::Var>());
+			if (auto maybe_id = match_id())
+				body->names.back()->name = ast->dom->names()->get(*maybe_id);
+			else
+				body->names.back()->name = ast->dom->names()->get("_");
+			body->body.push_back(parse_unar());
+			return fill(make<ast::Each>(), container, body);
+		}
 		if (auto name = match("_")) {
 			auto r = make<ast::Get>();
 			r->var_name = ast->dom->names()->get("_");
@@ -465,6 +488,32 @@ struct Parser {
 		error("syntax error");
 	}
 
+	pin<Action> parse_string() {
+		auto r = make<ast::ConstString>();
+		for (cur++, pos++; *cur != '"'; cur++, pos++) {
+			if (!*cur || *cur == '\n' || *cur == '\r')
+				error("unterminated string");
+			if (*cur != '\\') {
+				r->value += *cur;
+				continue;
+			}
+			cur++;
+			pos++;
+			switch (*cur) {
+			case 'n': r->value += '\n'; break;
+			case 'r': r->value += '\r'; break;
+			case 't': r->value += '\t'; break;
+			case '\\':
+			case '"': r->value += *cur; break;
+			default: error("unknown escape sequence");
+			}
+		}
+		cur++;
+		pos++;
+		match_ws();
+		return r;
+	}
+
 	template<typename T, typename VT>
 	pin<Action> mk_const(VT&& v) {
 		auto r = pin<T>::make();
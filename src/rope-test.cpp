@@ -0,0 +1,101 @@
+#include <string>
+#include "fake-gunit.h"
+#include "rope.h"
+
+namespace {
+
+using rope::Node;
+
+int64_t* buffers_freed_last = nullptr;
+int buffers_freed = 0;
+
+void free_buffer(int64_t* buffer) {
+	if (--buffer[-1] == 0) {
+		buffers_freed++;
+		buffers_freed_last = buffer;
+		delete[] (buffer - 1);
+	}
+}
+
+Node* make_leaf(const std::string& s) {  // Blob-style buffer with a counter in front
+	auto buffer = new int64_t[1 + (s.size() + 7) / 8];
+	buffer[0] = 1;
+	s.copy(reinterpret_cast<char*>(buffer + 1), s.size());
+	return rope::leaf(reinterpret_cast<char*>(buffer + 1), s.size(), buffer + 1);
+}
+
+std::string to_string(const Node* n) {
+	std::string r(rope::size(n), '\0');
+	rope::copy_to(n, &r[0]);
+	return r;
+}
+
+uint64_t check_balance(const Node* n) {  // returns height
+	if (!n || !n->height)
+		return 0;
+	auto l = n->left->height;
+	auto r = n->right->height;
+	ASSERT_TRUE(l <= r + 2 && r <= l + 2);
+	ASSERT_EQ(n->height, (l > r ? l : r) + 1);
+	ASSERT_EQ(n->size, n->left->size + n->right->size);
+	check_balance(n->left);
+	check_balance(n->right);
+	return n->height;
+}
+
+TEST(Rope, ConcatAndSlice) {
+	Node* r = nullptr;
+	std::string expected;
+	for (int i = 0; i < 1000; i++) {
+		auto s = std::to_string(i) + ",";
+		auto l = make_leaf(s);
+		auto next = i % 2 ? rope::concat(r, l) : rope::concat(l, r);
+		expected = i % 2 ? expected + s : s + expected;
+		rope::release(l, free_buffer);
+		rope::release(r, free_buffer);
+		r = next;
+	}
+	ASSERT_EQ(to_string(r), expected);
+	ASSERT_TRUE(check_balance(r) < 20);
+	for (uint64_t from = 0; from < expected.size(); from += 97) {
+		for (uint64_t to = from; to < expected.size() + 10; to += 131) {
+			auto s = rope::slice(r, from, to);
+			auto part = expected.substr(from, to - from);
+			ASSERT_EQ(to_string(s), part);
+			check_balance(s);
+			auto s2 = rope::slice(s, 1, 3);
+			ASSERT_EQ(to_string(s2), part.size() > 1 ? part.substr(1, 2) : "");
+			rope::release(s2, free_buffer);
+			rope::release(s, free_buffer);
+		}
+	}
+	ASSERT_EQ(rope::byte_at(r, 0), expected[0]);
+	ASSERT_EQ(rope::byte_at(r, 1234), expected[1234]);
+	ASSERT_EQ(rope::byte_at(r, expected.size()), -1);
+	ASSERT_EQ(buffers_freed, 0);
+	rope::release(r, free_buffer);
+	ASSERT_EQ(buffers_freed, 1000);
+}
+
+TEST(Rope, SharedBuffers) {
+	buffers_freed = 0;
+	auto a = make_leaf("hello, world");
+	auto buffer = a->buffer;
+	auto tail = rope::slice(a, 7, 100);
+	rope::release(a, free_buffer);
+	ASSERT_EQ(buffers_freed, 0);
+	auto twice = rope::concat(tail, tail);
+	ASSERT_EQ(to_string(twice), "worldworld");
+	auto middle = rope::slice(twice, 3, 7);
+	ASSERT_EQ(to_string(middle), "ldwo");
+	rope::release(tail, free_buffer);
+	rope::release(twice, free_buffer);
+	ASSERT_EQ(buffers_freed, 0);
+	rope::release(middle, free_buffer);
+	ASSERT_EQ(buffers_freed, 1);
+	ASSERT_TRUE(buffers_freed_last == buffer);
+	ASSERT_TRUE(rope::slice(nullptr, 0, 10) == nullptr);
+	ASSERT_TRUE(rope::concat(nullptr, nullptr) == nullptr);
+}
+
+}  // namespace
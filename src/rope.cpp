@@ -0,0 +1,162 @@
+#include "rope.h"
+
+#include <cstring>
+
+namespace rope {
+
+namespace {
+
+uint64_t height(const Node* n) { return n->height; }
+
+uint64_t& buffer_counter(int64_t* buffer) {
+	return reinterpret_cast<uint64_t*>(buffer)[-1];
+}
+
+Node* make(Node* left, Node* right) {  // takes over holders of both children
+	auto h = height(left) > height(right) ? height(left) : height(right);
+	return new Node{ 1, left->size + right->size, h + 1, left, right, nullptr, nullptr };
+}
+
+// Gives a holder for each child of inner node `n` and drops the holder of `n`.
+void take_children(Node* n, Node*& left, Node*& right) {
+	left = retain(n->left);
+	right = retain(n->right);
+	if (--n->counter == 0) {
+		--n->left->counter;  // can't reach zero, just retained
+		--n->right->counter;
+		delete n;
+	}
+}
+
+// Like `make`, heights can differ by up to 3, rotations bring them within 2.
+Node* balance(Node* left, Node* right) {
+	if (height(left) > height(right) + 2) {
+		Node *ll, *lr;
+		take_children(left, ll, lr);
+		if (height(ll) >= height(lr))
+			return make(ll, make(lr, right));
+		Node *lrl, *lrr;
+		take_children(lr, lrl, lrr);
+		return make(make(ll, lrl), make(lrr, right));
+	}
+	if (height(right) > height(left) + 2) {
+		Node *rl, *rr;
+		take_children(right, rl, rr);
+		if (height(rr) >= height(rl))
+			return make(make(left, rl), rr);
+		Node *rll, *rlr;
+		take_children(rl, rll, rlr);
+		return make(make(left, rll), make(rlr, rr));
+	}
+	return make(left, right);
+}
+
+// Descends the spine of the taller side to a subtree of matching height, so it takes O(height difference).
+Node* join(Node* left, Node* right) {  // takes over holders of both, both non-null
+	if (height(left) > height(right) + 2) {
+		Node *ll, *lr;
+		take_children(left, ll, lr);
+		return balance(ll, join(lr, right));
+	}
+	if (height(right) > height(left) + 2) {
+		Node *rl, *rr;
+		take_children(right, rl, rr);
+		return balance(join(left, rl), rr);
+	}
+	return make(left, right);
+}
+
+Node* prefix(Node* n, uint64_t count) {  // first `count` bytes
+	if (count == 0)
+		return nullptr;
+	if (count >= n->size)
+		return retain(n);
+	if (!n->height) {
+		++buffer_counter(n->buffer);
+		return leaf(n->bytes, count, n->buffer);
+	}
+	if (count <= n->left->size)
+		return prefix(n->left, count);
+	return join(retain(n->left), prefix(n->right, count - n->left->size));
+}
+
+Node* suffix(Node* n, uint64_t from) {  // bytes from `from` on
+	if (from >= n->size)
+		return nullptr;
+	if (from == 0)
+		return retain(n);
+	if (!n->height) {
+		++buffer_counter(n->buffer);
+		return leaf(n->bytes + from, n->size - from, n->buffer);
+	}
+	if (from >= n->left->size)
+		return suffix(n->right, from - n->left->size);
+	return join(suffix(n->left, from), retain(n->right));
+}
+
+}  // namespace
+
+Node* leaf(const char* bytes, uint64_t size, int64_t* buffer) {
+	return new Node{ 1, size, 0, nullptr, nullptr, bytes, buffer };
+}
+
+Node* retain(Node* n) {
+	if (n)
+		++n->counter;
+	return n;
+}
+
+void release(Node* n, void (*release_buffer)(int64_t* buffer)) {
+	while (n && --n->counter == 0) {  // loops down the right spine, recurses into the left one, depth stays O(log n)
+		auto next = n->right;
+		if (n->height)
+			release(n->left, release_buffer);
+		else
+			release_buffer(n->buffer);
+		delete n;
+		n = next;
+	}
+}
+
+Node* concat(Node* a, Node* b) {
+	if (!a || !b)
+		return retain(a ? a : b);
+	return join(retain(a), retain(b));
+}
+
+Node* slice(Node* n, uint64_t from, uint64_t to) {
+	if (!n || from >= to || from >= n->size)
+		return nullptr;
+	auto head = prefix(n, to);
+	auto r = suffix(head, from);
+	// Freed leaves of `head` can only be cut ones made by `prefix`, `n` still holds their buffers.
+	release(head, [](int64_t* buffer) { --buffer_counter(buffer); });
+	return r;
+}
+
+int byte_at(const Node* n, uint64_t index) {
+	if (!n || index >= n->size)
+		return -1;
+	while (n->height) {
+		if (index < n->left->size) {
+			n = n->left;
+		} else {
+			index -= n->left->size;
+			n = n->right;
+		}
+	}
+	return static_cast<uint8_t>(n->bytes[index]);
+}
+
+void copy_to(const Node* n, char* dst) {
+	for (; n; n = n->right) {
+		if (!n->height) {
+			memcpy(dst, n->bytes, n->size);
+			return;
+		}
+		copy_to(n->left, dst);
+		dst += n->left->size;
+	}
+}
+
+}  // namespace rope
@@ -0,0 +1,37 @@
+#ifndef _ROPE_H_
+#define _ROPE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Immutable byte sequence as a balanced tree of shared nodes, so concatenation and slicing take O(log n)
+// and never copy bytes. Leaves reference byte ranges of caller buffers that are laid out as Blob buffers,
+// with a holder counter in the word in front. A null node is the empty rope.
+// Functions take nodes without consuming them and return nodes with a new holder.
+namespace rope {
+
+struct Node {
+	uint64_t counter;  // holders
+	uint64_t size;     // bytes
+	uint64_t height;   // 0 for leaves, AVL-balanced with a slack of 2
+	Node* left;        // inner nodes
+	Node* right;
+	const char* bytes;  // leaves, inside `buffer`
+	int64_t* buffer;
+};
+
+// Takes over one holder of `buffer`, `size` must be > 0.
+Node* leaf(const char* bytes, uint64_t size, int64_t* buffer);
+Node* retain(Node* n);
+// `release_buffer` is called for the buffers of freed leaves, to drop the holder they had.
+void release(Node* n, void (*release_buffer)(int64_t* buffer));
+
+inline uint64_t size(const Node* n) { return n ? n->size : 0; }
+Node* concat(Node* a, Node* b);
+Node* slice(Node* n, uint64_t from, uint64_t to);  // [from, to) clamped to the rope
+int byte_at(const Node* n, uint64_t index);  // -1 if out of bounds
+void copy_to(const Node* n, char* dst);  // writes all `size(n)` bytes
+
+}  // namespace rope
+
+#endif  // _ROPE_H_
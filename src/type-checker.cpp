@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <functional>
 #include <vector>
 #include <cassert>
 
@@ -40,6 +41,7 @@ struct Typer : ast::ActionMatcher {
 	void on_const_double(ast::ConstDouble& node) override { node.type_ = ast->tp_double(); }
 	void on_const_void(ast::ConstVoid& node) override { node.type_ = ast->tp_void(); }
 	void on_const_bool (ast::ConstBool& node) override { node.type_ = tp_bool; }
+	void on_const_string(ast::ConstString& node) override { node.type_ = ast->get_ref(ast->string_cls); }
 	void on_mk_lambda(ast::MkLambda& node) override {
 		auto r = pin<ast::TpColdLambda>::make();
 		r->callees.push_back(weak<ast::MkLambda>(&node));
@@ -117,15 +119,67 @@ struct Typer : ast::ActionMatcher {
 		}
 	}
 	void on_call(ast::Call& node) override {
+		if (auto as_class = dom::strict_cast<ast::MkInstance>(node.callee)) {
+			if (as_class->cls == ast->own_array) {
+				on_typed_array(node);
+				return;
+			}
+		}
 		vector<pin<ast::Action>> params;
 		for (auto& p : node.params)
 			params.push_back(find_type(p));
-		type_call(node, find_type(node.callee), params);
+		find_type(node.callee);
+		if (auto as_fn_ref = dom::strict_cast<ast::MakeFnPtr>(node.callee); as_fn_ref && !params.empty())
+			type_typed_array_fn(*as_fn_ref, params.front());
+		type_call(node, node.callee, params);
+	}
+	// `sys_Array(T)` makes an array of T, see Ast::get_typed_array.
+	void on_typed_array(ast::Call& node) {
+		auto item = node.params.size() == 1 ? dom::strict_cast<ast::MkInstance>(find_type(node.params.front())) : nullptr;
+		if (!item)
+			node.error("expected sys_Array(ClassName)");
+		auto r = ast::make_at_location<ast::MkInstance>(node);
+		r->cls = ast->get_typed_array(item->cls);
+		*fix_result = r;
+		find_type(*fix_result);
+	}
+	// Item functions of sys_Array (Ast::typed_array_fns) called on sys_Array(T) take and return T instead of Object,
+	// so items need no casts. The call still goes to the sys_Array function, only its MakeFnPtr gets the typed signature.
+	void type_typed_array_fn(ast::MakeFnPtr& fn_ref, pin<ast::Action> array) {
+		auto cls = ast->extract_class(array->type());
+		auto item = cls && cls != ast->own_array ? ast->array_item(cls) : nullptr;
+		auto& fns = ast->typed_array_fns;
+		if (!item || std::find(fns.begin(), fns.end(), fn_ref.fn) == fns.end())
+			return;
+		std::function<pin<Type>(pin<Type>)> typed = [&](pin<Type> type) -> pin<Type> {
+			if (type == ast->object)
+				return item;
+			if (auto as_ref = dom::strict_cast<ast::TpRef>(type)) {
+				if (as_ref->target == ast->own_array)
+					return ast->get_ref(cls);
+				if (as_ref->target == ast->object)
+					return ast->get_ref(item);
+			}
+			if (auto as_opt = dom::strict_cast<ast::TpOptional>(type))
+				return ast->tp_optional(typed(ast->get_wrapped(as_opt)));
+			if (auto as_fn = dom::strict_cast<ast::TpFunction>(type)) {
+				vector<own<Type>> params;
+				for (auto& p : as_fn->params)
+					params.push_back(typed(p));
+				return dom::strict_cast<ast::TpLambda>(type)
+					? (pin<Type>) ast->tp_lambda(move(params))
+					: ast->tp_function(move(params));
+			}
+			return type;
+		};
+		fn_ref.type_ = typed(fn_ref.type());
 	}
 	void handle_index_op(ast::GetAtIndex& node, own<ast::Action> opt_value, const char* name) {
 		auto indexed = ast->extract_class(find_type(node.indexed)->type());
 		if (!indexed)
 			node.error("Only objects can be indexed, not ", node.indexed->type());
+		if (ast->array_item(indexed))  // sys_Array(T) shares sys_Array functions
+			indexed = ast->own_array;
 		auto fn = ast->functions_by_names[indexed->name->get(name)].pinned();
 		if (!fn)
 			node.error("function ", indexed->name->get(name), " not found");
@@ -200,6 +254,21 @@ struct Typer : ast::ActionMatcher {
 			node.error("loop body returned ", node.p->type().pinned(), ", that is not bool or optional");
 		}
 	}
+	void on_each(ast::Each& node) override {
+		auto cls = class_from_action(node.p[0]);
+		auto item = ast->array_item(cls);
+		if (cls != ast->blob && !item && cls != ast->weak_array && cls != ast->string_cls)
+			node.p[0]->error("each expects Blob, Array, WeakArray or String, not ", node.p[0]->type().pinned());
+		auto& item_type = dom::strict_cast<ast::Block>(node.p[1])->names.front()->type;
+		if (item) {
+			item_type = ast->tp_optional(ast->get_ref(item));
+		} else {
+			auto get_at = type_fn(ast->functions_by_names[cls->name->get("getAt")].pinned());
+			item_type = dom::strict_cast<ast::TpFunction>(get_at->type())->params.back();
+		}
+		find_type(node.p[1]);
+		node.type_ = ast->tp_void();
+	}
 	void on_get(ast::Get& node) override {
 		if (auto as_class = dom::strict_cast<ast::TpClass>(node.var->type)) {
 			// TODO in ret of fn result it still returns tpCls
@@ -463,6 +532,8 @@ struct Typer : ast::ActionMatcher {
 				expect_type(fn->body.back(), fn->type_expression->type());
 		}
 		expect_type(find_type(ast->entry_point), ast->tp_lambda({ ast->tp_int64() }));
+		for (size_t i = 1; i < ast->own_arrays.size(); i++)  // typed arrays have no fields or methods to check
+			ast->classes.push_back(ast->own_arrays[i].pinned());
 	}
 
 	pin<ast::Ast> ast;